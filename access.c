@@ -2,6 +2,7 @@
 
 #define	REQUIRE_STAT	1
 #define	REQUIRE_PARAM	1
+#define	REQUIRE_DIRENT	1
 
 #include "es.h"
 #include "prim.h"
@@ -178,8 +179,191 @@ PRIM(access) {
 	RefReturn(result);
 }
 
+/*
+ * path searching
+ *	%pathsearch used to be access -n $name -1e -xf $path, which
+ *	stats a file in every directory of $path up to the one holding
+ *	the program.  searchpath() does the same search, but remembers
+ *	the names in each absolute directory it has read, so a directory
+ *	without the program costs a stat of the directory (which network
+ *	filesystems answer from their attribute caches) rather than a
+ *	lookup of a name which is not there.  a directory is read again
+ *	when its device, inode or modification time changes; one modified
+ *	no earlier than the second it was read in may change again
+ *	without its mtime moving, so it is read on every search until it
+ *	settles.  a directory which does not exist holds nothing, so it
+ *	costs a single stat too.  tables for directories no longer in
+ *	$path are dropped when $path is assigned to.
+ */
+
+typedef struct PathDir PathDir;
+struct PathDir {
+	char *name;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	Boolean racy;		/* modified in the second it was read */
+	char *names;		/* the entries, each followed by '\0' */
+	size_t *table;		/* open hash of offsets into names, plus one */
+	size_t mask;
+	PathDir *next;
+};
+
+static PathDir *pathdirs = NULL;
+static unsigned long pathgeneration = 0;
+
+static void clearpathdir(PathDir *dir) {
+	if (dir->names != NULL)
+		efree(dir->names);
+	if (dir->table != NULL)
+		efree(dir->table);
+	dir->names = NULL;
+	dir->table = NULL;
+	dir->mask = 0;
+}
+
+/* readpathdir -- (re)build the table of names in a directory */
+static Boolean readpathdir(PathDir *dir, struct stat *st) {
+	DIR *dirp;
+	Dirent *dp;
+	size_t len, used = 0, size = 1024, count = 0, i, h;
+	char *s;
+	time_t now = time(NULL);
+
+	clearpathdir(dir);
+	if ((dirp = opendir(dir->name)) == NULL)
+		return FALSE;
+	dir->names = ealloc(size);
+	while ((dp = readdir(dirp)) != NULL) {
+		len = strlen(dp->d_name) + 1;
+		while (used + len > size)
+			dir->names = erealloc(dir->names, size *= 2);
+		memcpy(dir->names + used, dp->d_name, len);
+		used += len;
+		count++;
+	}
+	closedir(dirp);
+
+	for (dir->mask = 15; dir->mask < count * 2; dir->mask = dir->mask * 2 + 1)
+		;
+	dir->table = ealloc((dir->mask + 1) * sizeof (size_t));
+	memset(dir->table, 0, (dir->mask + 1) * sizeof (size_t));
+	for (s = dir->names; s < dir->names + used; s += strlen(s) + 1) {
+		for (h = strhash(s); dir->table[i = h & dir->mask] != 0; h++)
+			;
+		dir->table[i] = s - dir->names + 1;
+	}
+
+	dir->dev = st->st_dev;
+	dir->ino = st->st_ino;
+	dir->mtime = st->st_mtime;
+	dir->racy = (st->st_mtime >= now);
+	return TRUE;
+}
+
+/* currentdir -- an up to date table for a directory, or NULL if it cannot be read */
+static PathDir *currentdir(char *name, Boolean *absent) {
+	struct stat st;
+	PathDir *dir;
+	for (dir = pathdirs; dir != NULL; dir = dir->next)
+		if (streq(dir->name, name))
+			break;
+	if (stat(name, &st) == -1) {
+		*absent = (errno == ENOENT);
+		return NULL;
+	}
+	if (!S_ISDIR(st.st_mode))
+		return NULL;
+	if (dir == NULL) {
+		dir = ealloc(sizeof (PathDir));
+		dir->name = mprint("%s", name);
+		dir->names = NULL;
+		dir->table = NULL;
+		dir->next = pathdirs;
+		pathdirs = dir;
+	} else if (dir->table != NULL && !dir->racy
+		   && dir->dev == st.st_dev && dir->ino == st.st_ino
+		   && dir->mtime == st.st_mtime)
+		return dir;
+	return readpathdir(dir, &st) ? dir : NULL;
+}
+
+/* indir -- is there an entry with this name in the directory? */
+static Boolean indir(PathDir *dir, char *name) {
+	size_t h, off;
+	for (h = strhash(name); (off = dir->table[h & dir->mask]) != 0; h++)
+		if (streq(dir->names + off - 1, name))
+			return TRUE;
+	return FALSE;
+}
+
+/* prunepathdirs -- forget directories which have left $path */
+static void prunepathdirs(List *path) {
+	PathDir *dir, **dirp;
+	List *lp;
+	for (dirp = &pathdirs; (dir = *dirp) != NULL;) {
+		for (lp = path; lp != NULL; lp = lp->next)
+			if (streq(getstr(lp->term), dir->name))
+				break;
+		if (lp != NULL)
+			dirp = &dir->next;
+		else {
+			*dirp = dir->next;
+			clearpathdir(dir);
+			efree(dir->name);
+			efree(dir);
+		}
+	}
+}
+
+/* searchpath -- find an executable file in $path, as %pathsearch does */
+extern List *searchpath(char *name) {
+	int error, estatus = ENOENT;
+	char *dir, *file;
+	PathDir *pd;
+	List *lp;
+	Boolean absent, simple = (*name != '\0' && strchr(name, '/') == NULL);
+
+	gcdisable();
+	lp = varlookup("path", NULL);
+	if (pathgeneration != redefinitions) {
+		prunepathdirs(lp);
+		pathgeneration = redefinitions;
+	}
+	for (; lp != NULL; lp = lp->next) {
+		dir = getstr(lp->term);
+		if (simple && *dir == '/') {
+			absent = FALSE;
+			pd = currentdir(dir, &absent);
+			if (absent || (pd != NULL && !indir(pd, name)))
+				continue;
+		}
+		file = pathcat(dir, name);
+		error = testfile(file, EXEC, IFREG);
+		if (error == 0) {
+			Ref(List *, result, mklist(mkstr(gcdup(file)), NULL));
+			gcenable();
+			RefReturn(result);
+		} else if (error != ENOENT)
+			estatus = error;
+	}
+	Ref(char *, err, str("%s: %s", name, esstrerror(estatus)));
+	gcenable();
+	fail("$&access", "%s", err);	/* as access -1e reported it */
+	RefEnd(err);
+	NOTREACHED;
+	return NULL;
+}
+
+PRIM(pathsearch) {
+	if (list == NULL || list->next != NULL)
+		fail("$&pathsearch", "usage: %%pathsearch program");
+	return searchpath(getstr(list->term));
+}
+
 extern Dict *initprims_access(Dict *primdict) {
 	X(access);
+	X(pathsearch);
 	return primdict;
 }
 
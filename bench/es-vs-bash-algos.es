@@ -12,11 +12,11 @@ fn default value fallback {
 	}
 }
 
-fn iadd a b { result `{expr $a + $b} }
-fn imul a b { result `{expr $a \* $b} }
-fn imod a b { result `{expr $a % $b} }
-fn ieq a b { expr $a = $b >[1]/dev/null }
-fn ile a b { expr $a '<=' $b >[1]/dev/null }
+fn iadd a b { arith $a + $b }
+fn imul a b { arith $a '*' $b }
+fn imod a b { arith $a % $b }
+fn ieq a b { arithtest $a eq $b }
+fn ile a b { arithtest $a le $b }
 
 fn run-mandelbrot width height maxiter {
 	awk -v width=$width -v height=$height -v maxiter=$maxiter -f bench/mandelbrot.awk | wc -c >[1]/dev/null
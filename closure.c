@@ -7,7 +7,7 @@
  * Closure garbage collection support
  */
 
-DefineTag(Closure, static);
+DefineCellTag(Closure, static);
 
 extern Closure *mkclosure(Tree *tree, Binding *binding) {
 	gcdisable();
@@ -31,21 +31,6 @@ static size_t ClosureScan(void *p) {
 	return sizeof (Closure);
 }
 
-/* revtree -- destructively reverse a list stored in a tree */
-static Tree *revtree(Tree *tree) {
-	Tree *prev, *next;
-	if (tree == NULL)
-		return NULL;
-	prev = NULL;
-	do {
-		assert(tree->kind == nList);
-		next = tree->u[1].p;
-		tree->u[1].p = prev;
-		prev = tree;
-	} while ((tree = next) != NULL);
-	return prev;
-}
-
 static char *doconcat(Tree *word) {
 	NodeKind k = word->kind;
 	assert(gcisblocked());
@@ -62,6 +47,12 @@ struct Chain {
 };
 static Chain *chain = NULL;
 
+/* isnested -- is this word the $&nestedbinding marker? */
+static Boolean isnested(Tree *word) {
+	return word->kind == nPrim && streq(word->u[0].s, "nestedbinding");
+}
+
+/* extract -- build bindings from a %closure header, leaving the tree unchanged */
 static Binding *extract(Tree *tree, Binding *bindings) {
 	assert(gcisblocked());
 
@@ -69,56 +60,56 @@ static Binding *extract(Tree *tree, Binding *bindings) {
 		Tree *defn = tree->u[0].p;
 		assert(tree->kind == nList);
 		if (defn != NULL) {
-			List *list = NULL;
+			List *list = NULL, **tailp = &list;
 			Tree *name = defn->u[0].p;
 			assert(name->kind == nWord || name->kind == nQword);
-			defn = revtree(defn->u[1].p);
-			for (; defn != NULL; defn = defn->u[1].p) {
+			for (defn = defn->u[1].p; defn != NULL; defn = defn->u[1].p) {
 				Term *term;
-				Tree *word = defn->u[0].p;
+				Tree *word = defn->u[0].p, *next = defn->u[1].p;
 				assert(defn->kind == nList);
-				switch (word->kind) {
-				case nConcat:
-					term = mkstr(doconcat(word));
-					break;
-				case nWord: case nQword:
-					term = mkstr(word->u[0].s);
-					break;
-				case nPrim: {
-					if (streq(word->u[0].s, "nestedbinding")) {
-						int i, count;
-						Chain *cp;
-						if (
-							(defn = defn->u[1].p) == NULL
-						     || defn->u[0].p->kind != nWord
-						     || (count = (atoi(defn->u[0].p->u[0].s))) < 0
-						) {
-							fail("$&parse", "improper use of $&nestedbinding");
+				if (word->kind == nWord && next != NULL && isnested(next->u[0].p)) {
+					/* printed as ``count $&nestedbinding'' */
+					int i, count;
+					Chain *cp;
+					if ((count = atoi(word->u[0].s)) < 0) {
+						fail("$&parse", "improper use of $&nestedbinding");
+						NOTREACHED;
+					}
+					for (cp = chain, i = 0;; cp = cp->next, i++) {
+						if (cp == NULL) {
+							fail("$&parse", "bad count in $&nestedbinding: %d", count);
 							NOTREACHED;
 						}
-						for (cp = chain, i = 0;; cp = cp->next, i++) {
-							if (cp == NULL) {
-								fail("$&parse", "bad count in $&nestedbinding: %d", count);
-								NOTREACHED;
-							}
-							if (i == count)
-								break;
+						if (i == count)
+							break;
+					}
+					term = mkterm(NULL, cp->closure);
+					defn = next;
+				} else
+					switch (word->kind) {
+					case nConcat:
+						term = mkstr(doconcat(word));
+						break;
+					case nWord: case nQword:
+						term = mkstr(word->u[0].s);
+						break;
+					case nPrim:
+						if (isnested(word)) {
+							fail("$&parse", "improper use of $&nestedbinding");
+							NOTREACHED;
 						}
-						term = mkterm(NULL, cp->closure);
+						FALLTHROUGH;
+					case nLambda: case nThunk:
+						term = mkterm(NULL, mkclosure(word, NULL));
 						break;
+					case nCall: case nVar: case nVarsub:
+						fail("$&parse", "bad definition in %%closure: %T\n", defn);
+						NOTREACHED;
+					default:
+						NOTREACHED;
 					}
-				}
-				FALLTHROUGH;
-				case nLambda: case nThunk:
-					term = mkterm(NULL, mkclosure(word, NULL));
-					break;
-				case nCall: case nVar: case nVarsub:
-					fail("$&parse", "bad definition in %%closure: %T\n", defn);
-					NOTREACHED;
-				default:
-					NOTREACHED;
-				}
-				list = mklist(term, list);
+				*tailp = mklist(term, NULL);
+				tailp = &(*tailp)->next;
 			}
 			bindings = mkbinding(name->u[0].s, list, bindings);
 		}
@@ -173,7 +164,7 @@ extern Closure *extractbindings(Tree *tree0) {
  * Binding garbage collection support
  */
 
-DefineTag(Binding, static);
+DefineCellTag(Binding, static);
 
 extern Binding *mkbinding(char *name, List *defn, Binding *next) {
 	assert(next == NULL || next->name != NULL);
@@ -196,6 +187,7 @@ extern Binding *reversebindings(Binding *binding) {
 		do {
 			next = binding->next;
 			binding->next = prev;
+			gcremember(binding, prev);
 			prev = binding;
 		} while ((binding = next) != NULL);
 		return prev;
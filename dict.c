@@ -11,42 +11,162 @@
  * hashing
  */
 
-/* strhash2 -- the (probably too slow) haahr hash function */
+/*
+ * strhash2 -- the fnv-1a hash of the catenation of two strings, with
+ *	the high bits folded down into the low ones the tables mask off
+ */
 static unsigned long strhash2(const char *str1, const char *str2) {
+	const unsigned char *s;
+	unsigned long n = 2166136261UL;
+	assert(str1 != NULL);
+	for (s = (const unsigned char *) str1; *s != '\0'; s++)
+		n = (n ^ *s) * 16777619UL;
+	if (str2 != NULL)
+		for (s = (const unsigned char *) str2; *s != '\0'; s++)
+			n = (n ^ *s) * 16777619UL;
+	return n ^ (n >> 16);
+}
+
+/* strhash -- hash a single string */
+extern unsigned long strhash(const char *str) {
+	return strhash2(str, NULL);
+}
+
+
+/*
+ * symbols
+ *	names are interned as symbols:  canonical copies, outside the
+ *	collected heap and never freed, which carry their hash.  only the
+ *	parser interns, for the words it sees in name positions, so the
+ *	symbols grow with the code read rather than with the names a
+ *	program builds as it runs.  a lookup by symbol needs no hashing,
+ *	and a symbol key is matched by comparing pointers.  a symbol
+ *	remembers its ``fn-'' and ``set-'' forms so that function and
+ *	settor lookups need not build them.
+ */
+
+typedef struct Symbol Symbol;
+struct Symbol {
+	unsigned long hash;
+	char *fn, *set;			/* the prefixed forms, once wanted */
+	char name[1];			/* variable length */
+};
+
+#define	SYMBOL(s)	((Symbol *) ((s) - offsetof(Symbol, name)))
+#define	SYMCHUNK	(64 * 1024)
 
-#define	ADVANCE() { \
-		if ((c = *s++) == '\0') { \
-			if (str2 == NULL) \
-				break; \
-			else { \
-				s = (unsigned char *) str2; \
-				str2 = NULL; \
-				if ((c = *s++) == '\0') \
-					break; \
-			} \
-		} \
+typedef struct {
+	char *lo, *hi;
+} SymChunk;
+
+static Symbol **symtab = NULL;		/* open hash of all symbols */
+static size_t nsymbols = 0, symtabsize = 0;
+static SymChunk *symchunks = NULL;	/* where symbols are allocated, by address */
+static int nsymchunks = 0, cursymchunk = -1;
+static char *symlo = NULL, *symhi = NULL;	/* bounds of all the chunks */
+
+/* issymbol -- is a string an interned symbol? */
+extern Boolean issymbol(const char *s) {
+	int lo, hi;
+	if ((char *) s < symlo || (char *) s >= symhi)
+		return FALSE;
+	for (lo = 0, hi = nsymchunks; lo < hi;) {
+		int mid = (lo + hi) / 2;
+		if (s < symchunks[mid].lo)
+			hi = mid;
+		else if (s >= symchunks[mid].hi)
+			lo = mid + 1;
+		else
+			return TRUE;
 	}
+	return FALSE;
+}
 
-	unsigned int c;
-	unsigned long n = 0;
-	unsigned char *s = (unsigned char *) str1;
-	assert(str1 != NULL);
-	while (1) {
-		ADVANCE();
-		n += (c << 17) ^ (c << 11) ^ (c << 5) ^ (c >> 1);
-		ADVANCE();
-		n ^= (c << 14) + (c << 7) + (c << 4) + c;
-		ADVANCE();
-		n ^= (~c << 11) | ((c << 3) ^ (c >> 1));
-		ADVANCE();
-		n -= (c << 16) | (c << 9) | (c << 2) | (c & 3);
+/* symalloc -- find room for a new symbol */
+static Symbol *symalloc(size_t len) {
+	Symbol *sym;
+	size_t n = offsetof(Symbol, name[len + 1]);
+	n = (n + sizeof (void *) - 1) &~ (sizeof (void *) - 1);
+	if (cursymchunk < 0 || (size_t) (symchunks[cursymchunk].hi - symchunks[cursymchunk].lo) + n > SYMCHUNK) {
+		size_t size = n > SYMCHUNK ? n : SYMCHUNK;
+		char *chunk = ealloc(size);
+		int i;
+		symchunks = erealloc(symchunks, (nsymchunks + 1) * sizeof (SymChunk));
+		for (i = nsymchunks; i > 0 && symchunks[i - 1].lo > chunk; i--)
+			symchunks[i] = symchunks[i - 1];
+		symchunks[i].lo = symchunks[i].hi = chunk;
+		cursymchunk = i;
+		++nsymchunks;
+		if (symlo == NULL || chunk < symlo)
+			symlo = chunk;
+		if (chunk + size > symhi)
+			symhi = chunk + size;
 	}
-	return n;
+	sym = (Symbol *) symchunks[cursymchunk].hi;
+	symchunks[cursymchunk].hi += n;
+	return sym;
 }
 
-/* strhash -- hash a single string */
-static unsigned long strhash(const char *str) {
-	return strhash2(str, NULL);
+/* intern -- return the symbol for a name */
+extern char *intern(const char *s) {
+	size_t len, mask;
+	unsigned long h;
+	Symbol *sym;
+
+	if (issymbol(s))
+		return (char *) s;
+	if (nsymbols * 2 >= symtabsize) {
+		size_t i, oldsize = symtabsize;
+		Symbol **oldtab = symtab;
+		symtabsize = (symtabsize == 0) ? 512 : symtabsize * 2;
+		symtab = ealloc(symtabsize * sizeof (Symbol *));
+		memzero(symtab, symtabsize * sizeof (Symbol *));
+		mask = symtabsize - 1;
+		for (i = 0; i < oldsize; i++)
+			if ((sym = oldtab[i]) != NULL) {
+				for (h = sym->hash; symtab[h & mask] != NULL; h++)
+					;
+				symtab[h & mask] = sym;
+			}
+		if (oldtab != NULL)
+			efree(oldtab);
+	}
+
+	mask = symtabsize - 1;
+	for (h = strhash(s); (sym = symtab[h & mask]) != NULL; h++)
+		if (streq(sym->name, s))
+			return sym->name;
+
+	len = strlen(s);
+	sym = symalloc(len);
+	sym->hash = strhash(s);
+	sym->fn = sym->set = NULL;
+	memcpy(sym->name, s, len + 1);
+	symtab[h & mask] = sym;
+	++nsymbols;
+	return sym->name;
+}
+
+/* symprefix -- the symbol for a name with a prefix, which is remembered for fn- and set- */
+extern char *symprefix(const char *prefix, char *name) {
+	char **cache = NULL, *s, *buf;
+	size_t plen;
+	assert(issymbol(name));
+	if (streq(prefix, "fn-"))
+		cache = &SYMBOL(name)->fn;
+	else if (streq(prefix, "set-"))
+		cache = &SYMBOL(name)->set;
+	if (cache != NULL && *cache != NULL)
+		return *cache;
+	plen = strlen(prefix);
+	buf = ealloc(plen + strlen(name) + 1);
+	memcpy(buf, prefix, plen);
+	strcpy(buf + plen, name);
+	s = intern(buf);
+	efree(buf);
+	if (cache != NULL)
+		*cache = s;
+	return s;
 }
 
 
@@ -59,6 +179,7 @@ DefineTag(Dict, static);
 typedef struct {
 	char *name;
 	void *value;
+	unsigned long hash;	/* of name, which may or may not be a symbol */
 } Assoc;
 
 struct Dict {
@@ -98,74 +219,89 @@ static size_t DictScan(void *p) {
 
 /*
  * private operations
+ *	the table is open addressed with linear probing.  a key is a
+ *	symbol or a string in the heap; a symbol looked up is matched
+ *	by pointer first, and otherwise by its hash and then its text.
+ *	removal moves
+ *	later entries of the cluster back into the hole when that keeps
+ *	them reachable from the slots their hashes pick, so there are
+ *	never any tombstones for a lookup to step over.
  */
 
-static char DEAD[] = "DEAD";
+#define	DISTANCE(dict, n) \
+	(((n) - (dict)->table[n].hash) & ((dict)->size - 1))
+
+/* keyhash -- the hash of a name, without rehashing a symbol */
+static unsigned long keyhash(const char *name) {
+	return issymbol(name) ? SYMBOL(name)->hash : strhash(name);
+}
 
-static Assoc *get(Dict *dict, const char *name) {
+static Assoc *get(Dict *dict, const char *name, unsigned long hash) {
 	Assoc *ap;
-	unsigned long n = strhash(name), mask = dict->size - 1;
-	for (; (ap = &dict->table[n & mask])->name != NULL; n++)
-		if (ap->name != DEAD && streq(name, ap->name))
+	unsigned long n, mask = dict->size - 1;
+	for (n = hash; (ap = &dict->table[n & mask])->name != NULL; n++)
+		if (ap->name == name || (ap->hash == hash && streq(name, ap->name)))
 			return ap;
 	return NULL;
 }
 
-static void recurseput(void *, char *, void *);
+/* slot -- the empty slot where an entry with this hash belongs */
+static Assoc *slot(Dict *dict, unsigned long hash) {
+	Assoc *ap;
+	unsigned long n, mask = dict->size - 1;
+	for (n = hash; (ap = &dict->table[n & mask])->name != NULL; n++)
+		;
+	return ap;
+}
 
-static Dict *put(Dict *dict, char *name, void *value) {
-	unsigned long n, mask;
+static Dict *put(Dict *dict, char *name, void *value, unsigned long hash) {
 	Assoc *ap;
-	assert(get(dict, name) == NULL);
+	assert(get(dict, name, hash) == NULL);
 	assert(value != NULL);
 
 	if (dict->remain <= 1) {
+		int i;
 		Dict *new;
 		Ref(Dict *, old, dict);
 		Ref(char *, np, name);
 		Ref(void *, vp, value);
 		new = mkdict0(GROW(old->size));
-		dictforall(old, recurseput, new);
+		for (i = 0; i < old->size; i++)
+			if (old->table[i].name != NULL) {
+				*slot(new, old->table[i].hash) = old->table[i];
+				--new->remain;
+			}
 		dict = new;
 		name = np;
 		value = vp;
 		RefEnd3(vp, np, old);
 	}
 
-	n = strhash(name);
-	mask = dict->size - 1;
-	for (; (ap = &dict->table[n & mask])->name != DEAD; n++)
-		if (ap->name == NULL) {
-			--dict->remain;
-			break;
-		}
+	ap = slot(dict, hash);
+	--dict->remain;
 
 	ap->name = name;
 	ap->value = value;
+	ap->hash = hash;
+	gcremember(dict, name);
+	gcremember(dict, value);
 	return dict;
 }
 
-static void recurseput(void *v1, char *c, void *v2) {
-	put(v1, c, v2);
-}
-
-
 static void rm(Dict *dict, Assoc *ap) {
-	unsigned long n, mask;
+	unsigned long hole, n, mask;
 	assert(dict->table <= ap && ap < &dict->table[dict->size]);
 
-	ap->name = DEAD;
-	ap->value = NULL;
-	n = ap - dict->table;
 	mask = dict->size - 1;
-	for (n++; (ap = &dict->table[n & mask])->name == DEAD; n++)
-		;
-	if (ap->name != NULL)
-		return;
-	for (n--; (ap = &dict->table[n & mask])->name == DEAD; n--) {
-		ap->name = NULL;
-		++dict->remain;
-	}
+	hole = ap - dict->table;
+	for (n = (hole + 1) & mask; dict->table[n].name != NULL; n = (n + 1) & mask)
+		if (DISTANCE(dict, n) >= ((n - hole) & mask)) {
+			dict->table[hole] = dict->table[n];
+			hole = n;
+		}
+	dict->table[hole].name = NULL;
+	dict->table[hole].value = NULL;
+	++dict->remain;
 }
 
 
@@ -179,32 +315,53 @@ extern Dict *mkdict(void) {
 }
 
 extern void *dictget(Dict *dict, const char *name) {
-	Assoc *ap = get(dict, name);
+	Assoc *ap = get(dict, name, keyhash(name));
 	if (ap == NULL)
 		return NULL;
 	return ap->value;
 }
 
 extern Dict *dictput(Dict *dict, char *name, void *value) {
-	Assoc *ap = get(dict, name);
+	unsigned long hash = keyhash(name);
+	Assoc *ap = get(dict, name, hash);
 	if (value != NULL)
 		if (ap == NULL)
-			dict = put(dict, name, value);
-		else
+			dict = put(dict, name, value, hash);
+		else {
+			if (ap->name != name && issymbol(name))
+				ap->name = name;	/* so later lookups match by pointer */
 			ap->value = value;
+			gcremember(dict, value);
+		}
 	else if (ap != NULL)
 		rm(dict, ap);
 	return dict;
 }
 
+/*
+ * dictforall -- call proc on every entry
+ *	proc may change or remove the entry it is passed, but must not add
+ *	any.  the walk starts just after an empty slot, which no cluster
+ *	crosses, so the entries a removal moves back have not been seen
+ *	yet; when one lands in the slot just visited, that slot is visited
+ *	again.
+ */
 extern void dictforall(Dict *dp, void (*proc)(void *, char *, void *), void *arg) {
-	int i;
+	int i, start, mask;
 	Ref(Dict *, dict, dp);
 	Ref(void *, argp, arg);
-	for (i = 0; i < dict->size; i++) {
-		Assoc *ap = &dict->table[i];
-		if (ap->name != NULL && ap->name != DEAD)
-			(*proc)(argp, ap->name, ap->value);
+	mask = dict->size - 1;
+	for (start = 0; dict->table[start].name != NULL; start++)
+		;
+	for (i = 1; i <= dict->size; i++) {
+		char *name = dict->table[(start + i) & mask].name;
+		if (name != NULL) {
+			char *now;
+			(*proc)(argp, name, dict->table[(start + i) & mask].value);
+			now = dict->table[(start + i) & mask].name;
+			if (now != NULL && now != name)
+				--i;
+		}
 	}
 	RefEnd2(argp, dict);
 }
@@ -212,9 +369,30 @@ extern void dictforall(Dict *dp, void (*proc)(void *, char *, void *), void *arg
 /* dictget2 -- look up the catenation of two names (such a hack!) */
 extern void *dictget2(Dict *dict, const char *name1, const char *name2) {
 	Assoc *ap;
-	unsigned long n = strhash2(name1, name2), mask = dict->size - 1;
-	for (; (ap = &dict->table[n & mask])->name != NULL; n++)
-		if (ap->name != DEAD && streq2(ap->name, name1, name2))
+	unsigned long n, hash, mask = dict->size - 1;
+	if (issymbol(name2))
+		return dictget(dict, symprefix(name1, (char *) name2));
+	hash = strhash2(name1, name2);
+	for (n = hash; (ap = &dict->table[n & mask])->name != NULL; n++)
+		if (ap->hash == hash && streq2(ap->name, name1, name2))
 			return ap->value;
 	return NULL;
 }
+
+/* dictstats -- measure how well a dictionary is hashed */
+extern void dictstats(Dict *dict, DictStats *stats) {
+	int i;
+	stats->size = dict->size;
+	stats->symbols = nsymbols;
+	stats->count = 0;
+	stats->maxprobe = 0;
+	stats->totalprobe = 0;
+	for (i = 0; i < dict->size; i++)
+		if (dict->table[i].name != NULL) {
+			int probe = DISTANCE(dict, i) + 1;
+			++stats->count;
+			stats->totalprobe += probe;
+			if (probe > stats->maxprobe)
+				stats->maxprobe = probe;
+		}
+}
@@ -123,8 +123,10 @@ static Boolean deepequal(Tree *t1, Tree *t2) {
 	switch (t1->kind) {
 	case nWord: case nQword: case nPrim:
 		return nstreq(t1->u[0].s, t2->u[0].s);
-	case nCall: case nThunk: case nVar:
+	case nCall: case nThunk:
 		return deepequal(t1->u[0].p, t2->u[0].p);
+	case nVar:
+		return deepequal(t1->u[0].p, t2->u[0].p) && t1->u[1].i == t2->u[1].i;
 	case nAssign: case nConcat: case nClosure: case nFor:
 	case nLambda: case nLet: case nList: case nLocal:
 	case nVarsub: case nMatch: case nExtract:
@@ -158,10 +160,14 @@ static char *dumptree(Tree *tree) {
 			print("static const Tree_s %s = { n%s, { { (char *) %s } } };\n",
 			      name + 1, nodename(tree->kind), dumpstring(tree->u[0].s));
 			break;
-		    case nCall: case nThunk: case nVar:
+		    case nCall: case nThunk:
 			print("static const Tree_p %s = { n%s, { { (Tree *) %s } } };\n",
 			      name + 1, nodename(tree->kind), dumptree(tree->u[0].p));
 			break;
+		    case nVar:
+			print("static const Tree_pi %s = { n%s, { { (Tree *) %s } }, { %d } };\n",
+			      name + 1, nodename(tree->kind), dumptree(tree->u[0].p), tree->u[1].i);
+			break;
 		    case nAssign: case nConcat: case nClosure: case nFor:
 		    case nLambda: case nLet: case nList:  case nLocal:
 		    case nVarsub: case nMatch: case nExtract:
@@ -270,7 +276,8 @@ static void dumpvariables(void UNUSED *ignore, char *key, void *value) {
 #define TreeTypes \
 	typedef struct { NodeKind k; struct { char *s; } u[1]; } Tree_s; \
 	typedef struct { NodeKind k; struct { Tree *p; } u[1]; } Tree_p; \
-	typedef struct { NodeKind k; struct { Tree *p; } u[2]; } Tree_pp;
+	typedef struct { NodeKind k; struct { Tree *p; } u[2]; } Tree_pp; \
+	typedef struct { NodeKind k; struct { Tree *p; } u[1]; struct { int i; } v; } Tree_pi;
 TreeTypes
 #define	PPSTRING(s)	STRING(s)
 
@@ -280,6 +287,8 @@ static void printheader(List *title) {
 		|| offsetof(Tree, u[0].p) != offsetof(Tree_p,  u[0].p)
 		|| offsetof(Tree, u[0].p) != offsetof(Tree_pp, u[0].p)
 		|| offsetof(Tree, u[1].p) != offsetof(Tree_pp, u[1].p)
+		|| offsetof(Tree, u[0].p) != offsetof(Tree_pi, u[0].p)
+		|| offsetof(Tree, u[1].i) != offsetof(Tree_pi, v.i)
 	)
 		panic("dumpstate: Tree union sizes do not match struct sizes");
 
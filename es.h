@@ -73,6 +73,23 @@ typedef struct {
 	char *vector[1];
 } Vector;			/* environment or arguments */
 
+typedef struct {
+	char *type;			/* the name of a tag */
+	unsigned long count, bytes;	/* live objects with that tag */
+} GCCensus;			/* the live heap by type, see gccensus() */
+
+typedef struct {
+	char *type, *var;		/* var roots the object, or is NULL */
+	unsigned long bytes;
+} GCLargest;			/* one of the largest live objects or variables */
+
+typedef struct {
+	int size, count;		/* slots and entries */
+	int maxprobe;			/* the longest lookup, in slots */
+	unsigned long totalprobe;	/* slots looked at to find every entry */
+	unsigned long symbols;		/* names interned, for all tables */
+} DictStats;			/* see dictstats() */
+
 
 /*
  * our programming environment
@@ -109,6 +126,9 @@ extern int fdmap(int fd);
 extern int defer_mvfd(Boolean parent, int old, int new);
 extern int defer_close(Boolean parent, int fd);
 extern void undefer(int ticket);
+#if USE_SPAWN
+extern Boolean spawnfds(posix_spawn_file_actions_t *actions);
+#endif
 
 
 /* term.c */
@@ -154,14 +174,20 @@ extern List *forkexec(char *file, List *list, Boolean inchild);
 extern List *walk(Tree *tree, Binding *binding, int flags);
 extern List *eval(List *list, Binding *binding, int flags);
 extern List *eval1(Term *term, int flags);
+extern List *tailcall(List *list, int flags);
+extern List *escape(List *e, int flags);
+extern Boolean escaping(List *list);
 extern List *pathsearch(Term *term);
 
 extern unsigned long evaldepth, maxevaldepth;
+extern Boolean controlcaught;
 #define	MINmaxevaldepth		100
 #define	MAXmaxevaldepth		0xffffffffU
 
 #define	eval_inchild		1
 #define	eval_exitonfalse	2
+#define	eval_tailcall		4	/* only passed to primitives; see tailcall() */
+#define	eval_escape		8	/* caller takes escape markers; see escape() */
 #define	eval_flags		(eval_inchild|eval_exitonfalse)
 
 
@@ -192,12 +218,19 @@ extern void hidevariables(void);
 extern void validatevar(const char *var);
 extern List *varlookup(const char *name, Binding *binding);
 extern List *varlookup2(char *name1, char *name2, Binding *binding);
+extern Boolean isbound2(char *name1, char *name2, Binding *binding);
 extern void vardef(char *, Binding *, List *);
 extern Vector *mkenv(void);
 extern void setnoexport(List *list);
 extern void addtolist(void *arg, char *key, void *value);
 extern List *listvars(Boolean internal);
 extern List *varswithprefix(const char *prefix);
+extern void freezevars(List *names);
+extern int censusvars(GCCensus types[], int ntypes,
+		      GCLargest largest[], int nlargest, GCLargest holders[], int nholders);
+extern void varstats(DictStats *stats);
+extern unsigned long rebindings;	/* counts assignments to lexical variables */
+extern unsigned long redefinitions;	/* counts changes to fn- variables and $path */
 
 typedef struct Push Push;
 extern Push *pushlist;
@@ -217,12 +250,16 @@ extern void printstatus(int pid, int status);
 /* access.c */
 
 extern char *checkexecutable(char *file);
+extern List *searchpath(char *name);
 
 
 /* proc.c */
 
 extern Boolean hasforked;
 extern int efork(Boolean parent, Boolean background);
+#if USE_SPAWN
+extern int espawn(char *file, char **argv, char **envp);
+#endif
 extern pid_t spgrp(pid_t pgid);
 extern int tctakepgrp(void);
 extern void initpgrp(void);
@@ -245,6 +282,11 @@ extern void dictforall(Dict *dict, void (*proc)(void *, char *, void *), void *a
 extern void *dictget(Dict *dict, const char *name);
 extern Dict *dictput(Dict *dict, char *name, void *value);
 extern void *dictget2(Dict *dict, const char *name1, const char *name2);
+extern void dictstats(Dict *dict, DictStats *stats);
+extern unsigned long strhash(const char *str);
+extern char *intern(const char *s);			/* the symbol for a name */
+extern Boolean issymbol(const char *s);
+extern char *symprefix(const char *prefix, char *name);	/* the symbol for prefix^name */
 
 
 /* conv.c */
@@ -299,11 +341,11 @@ extern List *runfd(int fd, const char *name, int flags);
 extern List *runstring(const char *str, const char *name, int flags);
 
 /* eval_* flags are also understood as runflags */
-#define	run_interactive		 4	/* -i or $0[0] = '-' */
-#define	run_noexec		 8	/* -n */
-#define	run_echoinput		16	/* -v */
-#define	run_printcmds		32	/* -x */
-#define	run_lisptrees		64	/* -L and defined(LISPTREES) */
+#define	run_interactive		 16	/* -i or $0[0] = '-' */
+#define	run_noexec		 32	/* -n */
+#define	run_echoinput		 64	/* -v */
+#define	run_printcmds		128	/* -x */
+#define	run_lisptrees		256	/* -L and defined(LISPTREES) */
 
 #if HAVE_READLINE
 extern Boolean resetterminal;
@@ -370,6 +412,9 @@ extern void sigchk(void);
 extern Boolean issilentsignal(List *e);
 extern void exitonsignal(List *e);
 extern void setsigdefaults(void);
+#if USE_SPAWN
+extern void sigdefaultset(sigset_t *set);
+#endif
 extern void blocksignals(void);
 extern void unblocksignals(void);
 
@@ -397,11 +442,45 @@ extern char *gcndup(const char *s, size_t n);	/* copy a counted string into gc s
 
 extern void initgc(void);			/* must be called at the dawn of time */
 extern void gc(void);				/* provoke a collection, if enabled */
+extern void gcfull(void);			/* provoke a collection of all generations */
 extern void gcreserve(size_t nbytes);		/* provoke a collection, if enabled and not enough space */
 extern void gcenable(void);			/* enable collections */
 extern void gcdisable(void);			/* disable collections */
 extern Boolean gcisblocked(void);		/* is collection disabled? */
 
+/* collector statistics, as reported by $&gcstats */
+#define	NGCPAUSES	32			/* pauses are bucketed by log2 of microseconds */
+typedef struct {
+	unsigned long collections, minor, major;	/* number of collections */
+	unsigned long copied;			/* bytes copied by collections */
+	unsigned long allocated;		/* bytes allocated */
+	unsigned long minspace, minpspace;	/* current minimum space sizes */
+	unsigned long pauses[NGCPAUSES];	/* pauses[i] are < 2^i microseconds long */
+} GCStats;
+
+extern void gcstats(GCStats *stats);		/* fill in collector statistics */
+extern void gcresetstats(void);			/* zero the collector counters */
+
+typedef enum { gcMaxPause, gcGrowth, gcMinSpace, gcMaxHeap } GCPolicy;
+extern void gcsetpolicy(GCPolicy which, unsigned long value);	/* tune the collector; 0 for the default */
+extern Boolean gcexhausted;			/* live data has outgrown gc-max-heap */
+
+#if GCMOSTLYCOPY
+extern void gcsetstack(void *base);		/* note the base of the C stack */
+#endif
+extern void gcremember(void *p, const void *value);	/* write barrier: p now points to value */
+extern void gcfreeze(void **ptrs[], size_t n);	/* make what *ptrs[i] reach permanent */
+extern int gccensus(char *names[], void *roots[], size_t n,
+		    GCCensus types[], int ntypes,
+		    GCLargest largest[], int nlargest,
+		    GCLargest holders[], int nholders);	/* count the live heap, see $&heapcensus */
+
+/* allocation sampling, as reported by $&allocprofile */
+extern Boolean gcprofiling;			/* are allocations being sampled? */
+extern void gcprofile(size_t nbytes);		/* sample every nbytes allocated; stop if 0 */
+extern void gcprofframe(unsigned long depth, char **name);	/* where eval at depth keeps its function name */
+extern void gcprofforall(void (*proc)(void *, char *, unsigned long), void *arg);
+
 /* operations with pspace, the explicitly-collected gc space for parse tree building */
 extern void *palloc(size_t n, Tag *t);		/* allocate n with collection tag t, but in pspace */
 extern void *pseal(void *p);			/* collect pspace into gcspace with root p */
@@ -427,6 +506,36 @@ extern Root *rootlist;
 #define	refassert(e)	NOP
 #endif
 
+#if GCMOSTLYCOPY
+/*
+ * the collector scans the C stack conservatively, so Ref() only declares v.
+ * v's address still escapes, as it did into the Root, so that a value
+ * assigned inside an ExceptionHandler survives the longjmp to its catcher.
+ */
+#if __GNUC__
+#define	refescape(v)	__asm__ __volatile__ ("" : : "g" (&v) : "memory")
+#else
+extern void *volatile refsink;
+#define	refescape(v)	(refsink = (void *) &v)
+#endif
+#define	Ref(t, v, init) \
+	if (0) ; else { \
+		t v = init; \
+		refescape(v)
+#define	RefPop(v)	NOP
+#define RefEnd(v) \
+		RefPop(v); \
+	}
+#define RefReturn(v) \
+		RefPop(v); \
+		return v; \
+	}
+#define	RefAdd(e) \
+	if (0) ; else { \
+		refescape(e)
+#define	RefRemove(e) \
+	}
+#else
 #define	Ref(t, v, init) \
 	if (0) ; else { \
 		t v = init; \
@@ -456,6 +565,7 @@ extern Root *rootlist;
 		refassert(rootlist->p == (void **) &e); \
 		rootlist = rootlist->next; \
 	}
+#endif
 
 #define	RefEnd2(v1, v2)		RefEnd(v1); RefEnd(v2)
 #define	RefEnd3(v1, v2, v3)	RefEnd(v1); RefEnd2(v2, v3)
@@ -506,6 +616,7 @@ struct Handler {
 	Root *rootlist;
 	Push *pushlist;
 	unsigned long evaldepth;
+	Boolean controlcaught;
 	sigjmp_buf label;
 };
 
@@ -528,6 +639,7 @@ extern List *raised(List *e);
 		_localhandler.rootlist = rootlist; \
 		_localhandler.pushlist = pushlist; \
 		_localhandler.evaldepth = evaldepth; \
+		_localhandler.controlcaught = controlcaught; \
 		_localhandler.up = tophandler; \
 		tophandler = &_localhandler; \
 		if (!sigsetjmp(_localhandler.label, 0)) {
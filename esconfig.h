@@ -39,16 +39,44 @@
  *		declarations should cause a crash or assertion failure very
  *		quickly in this mode.
  *
+ *	GCBIBOP
+ *		if this is on (the default), lists, terms, bindings, closures,
+ *		and string lists are allocated in pages which each hold
+ *		objects of a single type, rather than with a header word
+ *		identifying the type of each object.
+ *
  *	GCDEBUG
  *		when this is on, the garbage collector is run in such a way
  *		that just about any coding error will lead to an almost
  *		immediate crash.  it is equivalent to all 3 of GCALWAYS,
  *		GCPROTECT, and GCVERBOSE
  *
+ *	GCGENERATIONAL
+ *		if this is on (the default), the garbage collector keeps
+ *		newly allocated objects in a nursery which is collected
+ *		separately from the data which has survived a collection,
+ *		so that most collections only copy recently allocated
+ *		data.  it is turned off by GCPROTECT.
+ *
+ *	GCHUGEPAGES
+ *		if this is on, large garbage collector spaces are marked
+ *		as candidates for transparent huge pages, with madvise(2).
+ *		this can speed up shells with big heaps, at some cost in
+ *		memory.  off by default; it has no effect if the system
+ *		lacks MADV_HUGEPAGE.
+ *
  *	GCINFO
  *		a terse version of GCVERBOSE, which prints a short message
  *		for every collection.
  *
+ *	GCMOSTLYCOPY
+ *		if this is on, the garbage collector finds references from
+ *		the C stack by scanning it conservatively, and keeps in
+ *		place any space that the stack may point into, rather than
+ *		relying on Ref() declarations, which then compile to plain
+ *		local variables.  off by default; it turns off GCBIBOP,
+ *		GCGENERATIONAL, and GCPROTECT.
+ *
  *	GCPROTECT
  *		makes the garbage collector disable access to pages
  *		that are in old space, making unforwarded references
@@ -152,6 +180,13 @@
  *		define this on a system which has its own typedef for
  *		sig_atomic_t.
  *
+ *	USE_SPAWN
+ *		if this is on, commands run by the shell itself (rather than
+ *		by a subshell) are started with posix_spawn(3), which need not
+ *		copy the shell's address space, when their redirections can
+ *		be expressed as spawn file actions.  on by default if the
+ *		system has posix_spawn.
+ *
  *	USE_STDARG
  *		define this if you have an ansi compiler and the <stdarg.h>
  *		header file.  if not, es will try to use <varargs.h>, but
@@ -275,14 +310,30 @@
 #define	GCALWAYS		0
 #endif
 
+#ifndef	GCBIBOP
+#define	GCBIBOP			1
+#endif
+
 #ifndef	GCDEBUG
 #define	GCDEBUG			0
 #endif
 
+#ifndef	GCGENERATIONAL
+#define	GCGENERATIONAL		1
+#endif
+
+#ifndef	GCHUGEPAGES
+#define	GCHUGEPAGES		0
+#endif
+
 #ifndef	GCINFO
 #define	GCINFO			0
 #endif
 
+#ifndef	GCMOSTLYCOPY
+#define	GCMOSTLYCOPY		0
+#endif
+
 #ifndef	GCPROTECT
 #define	GCPROTECT		0
 #endif
@@ -327,6 +378,14 @@
 #define	USE_SIG_ATOMIC_T	0
 #endif
 
+#ifndef	USE_SPAWN
+#if HAVE_POSIX_SPAWN && HAVE_SPAWN_H
+#define	USE_SPAWN		1
+#else
+#define	USE_SPAWN		0
+#endif
+#endif
+
 /*
  * enforcing choices that must be made
  */
@@ -342,6 +401,20 @@
 #define	GCVERBOSE		1
 #endif
 
+#if GCMOSTLYCOPY
+#undef	GCBIBOP
+#undef	GCGENERATIONAL
+#undef	GCPROTECT
+#define	GCBIBOP			0
+#define	GCGENERATIONAL		0
+#define	GCPROTECT		0
+#endif
+
+#if GCPROTECT
+#undef	GCGENERATIONAL
+#define	GCGENERATIONAL		0
+#endif
+
 #if HAVE_SIGACTION
 #undef	SYSV_SIGNALS
 #define	SYSV_SIGNALS		0
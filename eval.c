@@ -1,6 +1,8 @@
 /* eval.c -- evaluation of lists and trees ($Revision: 1.2 $) */
 
 #include "es.h"
+#include "prim.h"
+#include "term.h"
 
 unsigned long evaldepth = 0, maxevaldepth = MAXmaxevaldepth;
 
@@ -28,7 +30,13 @@ extern List *forkexec(char *file, List *list, Boolean inchild) {
 	Vector *env;
 	gcdisable();
 	env = mkenv();
-	pid = efork(!inchild, FALSE);
+	pid = -1;
+#if USE_SPAWN
+	if (!inchild)
+		pid = espawn(file, vectorize(list)->vector, env->vector);
+#endif
+	if (pid == -1)
+		pid = efork(!inchild, FALSE);
 	if (pid == 0) {
 		execve(file, vectorize(list)->vector, env->vector);
 		failexec(file, list);
@@ -162,6 +170,8 @@ static List *local(Tree *defn, Tree *body0,
 static List *forloop(Tree *defn0, Tree *body0,
 		     Binding *binding, int evalflags) {
 	static List MULTIPLE = { NULL, NULL };
+	Boolean caught;
+	Atomic again;
 
 	Ref(List *, result, ltrue);
 	Ref(Binding *, outer, binding);
@@ -190,44 +200,72 @@ static List *forloop(Tree *defn0, Tree *body0,
 	looping = reversebindings(looping);
 	RefEnd(defn);
 
-	ExceptionHandler
-
-		for (;;) {
-			Boolean allnull = TRUE;
-			Ref(Binding *, bp, outer);
-			Ref(Binding *, lp, looping);
-			Ref(Binding *, sequence, NULL);
-			for (; lp != NULL; lp = lp->next) {
-				Ref(List *, value, NULL);
-				if (lp->defn != &MULTIPLE)
-					sequence = lp;
-				assert(sequence != NULL);
-				if (sequence->defn != NULL) {
-					value = mklist(sequence->defn->term,
-						       NULL);
-					sequence->defn = sequence->defn->next;
-					allnull = FALSE;
+	caught = controlcaught;
+	do {
+		again = FALSE;
+
+		ExceptionHandler
+
+			controlcaught = TRUE;
+			for (;;) {
+				Boolean allnull = TRUE;
+				Ref(Binding *, bp, outer);
+				Ref(Binding *, lp, looping);
+				Ref(Binding *, sequence, NULL);
+				for (; lp != NULL; lp = lp->next) {
+					Ref(List *, value, NULL);
+					if (lp->defn != &MULTIPLE)
+						sequence = lp;
+					assert(sequence != NULL);
+					if (sequence->defn != NULL) {
+						value = mklist(sequence->defn->term,
+							       NULL);
+						sequence->defn = sequence->defn->next;
+						gcremember(sequence, sequence->defn);
+						allnull = FALSE;
+					}
+					bp = mkbinding(lp->name, value, bp);
+					RefEnd(value);
 				}
-				bp = mkbinding(lp->name, value, bp);
-				RefEnd(value);
-			}
-			RefEnd2(sequence, lp);
-			if (allnull) {
-				RefPop(bp);
-				break;
+				RefEnd2(sequence, lp);
+				if (allnull) {
+					RefPop(bp);
+					break;
+				}
+				result = walk(body, bp, (evalflags & eval_exitonfalse)
+							| eval_escape);
+				RefEnd(bp);
+				if (escaping(result)) {
+					List *e = result->next;
+					if (termeq(e->term, "continue"))
+						result = ltrue;
+					else {
+						if (termeq(e->term, "break"))
+							result = e->next;
+						break;
+					}
+				}
+				SIGCHK();
 			}
-			result = walk(body, bp, evalflags & eval_exitonfalse);
-			RefEnd(bp);
-			SIGCHK();
-		}
 
-	CatchException (e)
+		CatchException (e)
 
-		if (!termeq(e->term, "break"))
-			throw(e);
-		result = e->next;
+			if (termeq(e->term, "break"))
+				result = e->next;
+			else if (termeq(e->term, "continue")) {
+				result = ltrue;
+				again = TRUE;
+			} else
+				result = escape(e, evalflags);
 
-	EndExceptionHandler
+		EndExceptionHandler
+
+	} while (again);
+	controlcaught = caught;
+
+	/* a return from the body goes on up to the enclosing function */
+	if (escaping(result))
+		result = escape(result->next, evalflags);
 
 	RefEnd3(body, looping, outer);
 	RefReturn(result);
@@ -263,6 +301,45 @@ static List *extractpattern(Tree *subjectform0, Tree *patternform0,
 	RefReturn(result);
 }
 
+/* hascall -- can evaluating (or glomming) this tree run a command? */
+static Boolean hascall(Tree *tree) {
+	if (tree == NULL)
+		return FALSE;
+	switch (tree->kind) {
+	    case nWord: case nQword: case nPrim: case nThunk: case nLambda:
+		return FALSE;
+	    case nVar:
+		return hascall(tree->u[0].p);
+	    case nVarsub: case nConcat: case nList:
+	    case nAssign: case nMatch: case nExtract:
+		return hascall(tree->u[0].p) || hascall(tree->u[1].p);
+	    default:
+		return TRUE;
+	}
+}
+
+/* guardwalk -- walk a tree which may throw an escape, catching it */
+static List *guardwalk(Tree *tree0, Binding *binding0, int flags) {
+	Ref(List *, result, NULL);
+	Ref(Tree *, tree, tree0);
+	Ref(Binding *, binding, binding0);
+
+	ExceptionHandler
+
+		controlcaught = TRUE;
+		result = walk(tree, binding, flags);
+		controlcaught = FALSE;
+
+	CatchException (e)
+
+		result = escape(e, flags);
+
+	EndExceptionHandler
+
+	RefEnd2(binding, tree);
+	RefReturn(result);
+}
+
 /* walk -- walk through a tree, evaluating nodes */
 extern List *walk(Tree *tree0, Binding *binding0, int flags) {
 	Tree *volatile tree = tree0;
@@ -274,6 +351,20 @@ top:
 	if (tree == NULL)
 		return ltrue;
 
+	/* glom runs commands with no way to pass an escape back */
+	if ((flags & eval_escape) && !controlcaught) {
+		Tree *t = tree;
+		switch (tree->kind) {
+		    case nLet: case nClosure: case nLocal: case nFor:
+			t = tree->u[0].p;
+			break;
+		    default:
+			break;
+		}
+		if (hascall(t))
+			return guardwalk(tree, binding, flags);
+	}
+
 	switch (tree->kind) {
 
 	    case nConcat: case nList: case nQword: case nVar: case nVarsub:
@@ -348,34 +439,220 @@ extern Binding *bindargs(Tree *params, List *args, Binding *binding) {
 /* pathsearch -- evaluate fn %pathsearch + some argument */
 extern List *pathsearch(Term *term) {
 	List *list;
+	Closure *cp;
 	Ref(List *, search, NULL);
 	search = varlookup("fn-%pathsearch", NULL);
 	if (search == NULL)
 		fail("es:pathsearch", "%E: fn %%pathsearch undefined", term);
+	if (search->next == NULL
+	    && (cp = getclosure(search->term)) != NULL
+	    && cp->tree->kind == nPrim
+	    && streq(cp->tree->u[0].s, "pathsearch")) {
+		RefPop(search);
+		return searchpath(getstr(term));
+	}
 	list = mklist(term, NULL);
 	list = append(search, list);
 	RefEnd(search);
 	return eval(list, NULL, 0);
 }
 
-/* eval -- evaluate a list, producing a list */
-extern List *eval(List *list0, Binding *binding0, int flags) {
-	Closure *volatile cp;
-	List *fn;
+/*
+ * command cache
+ *	a command name is looked up as fn-name and then, failing that,
+ *	with %pathsearch every time it is run.  a direct-mapped cache,
+ *	keyed by the address of the name, remembers the function found,
+ *	or that there was none.  the name of a literal command is the
+ *	string in its parse tree, so each call site has a slot of its
+ *	own.  entries stay good until a fn- variable or $path changes;
+ *	lexical bindings vary from call to call, so they are searched
+ *	first as before.  programs are still looked for each time, since
+ *	what is in the directories of $path can change under the shell;
+ *	the stock %pathsearch keeps its own cache which notices that.
+ *	the slots are global roots, as in the conversion caches in term.c.
+ */
+
+#define	NCMDCACHE	256
+#define	CMDSLOT(p)	((((unsigned long) (p)) >> 4) & (NCMDCACHE - 1))
+
+static struct {
+	char *name;
+	List *fn;			/* fn-name, or NULL */
+	unsigned long redefinitions;
+} cmdcache[NCMDCACHE];
+
+static void initcmdcache(void) {
+	static Boolean initialized = FALSE;
+	int i;
+	if (initialized)
+		return;
+	initialized = TRUE;
+	for (i = 0; i < NCMDCACHE; i++) {
+		globalroot(&cmdcache[i].name);
+		globalroot(&cmdcache[i].fn);
+	}
+}
 
-	if (++evaldepth >= maxevaldepth)
-		fail("es:eval", "max-eval-depth exceeded");
+/* cmdcached -- the cache slot for a name, if it is current */
+static int cmdcached(char *name) {
+	int slot = CMDSLOT(name);
+	if (cmdcache[slot].name == name
+	    && cmdcache[slot].redefinitions == redefinitions)
+		return slot;
+	return -1;
+}
+
+/* cmdremember -- cache what a name was found to be */
+static void cmdremember(char *name, List *fn) {
+	int slot = CMDSLOT(name);
+	initcmdcache();
+	cmdcache[slot].name = name;
+	cmdcache[slot].fn = fn;
+	cmdcache[slot].redefinitions = redefinitions;
+}
 
+/*
+ * escapes
+ *	return, break and continue are exceptions, but catching them
+ *	with handlers costs a sigsetjmp in every function call.  so,
+ *	when its caller says (with eval_escape) that it can take one,
+ *	$&throw hands these back as an escape marker instead, which
+ *	every escape-aware frame passes up as its result until the
+ *	function or loop which consumes it is reached.  the frames in
+ *	between unwind as they would on a normal return, popping their
+ *	local bindings and running nothing else.
+ *
+ *	code which is not escape-aware -- most primitives, glom, and
+ *	anything else which calls eval() without eval_escape -- still
+ *	sees a real exception.  a function runs with controlcaught
+ *	false, meaning nothing between it and the innermost handler
+ *	would catch its return, so entering such code from its body
+ *	first installs a handler which turns the exception back into
+ *	a marker.  this is what each function call used to do, but is
+ *	now only done where it is needed.
+ */
+
+static Term escapeterm = { "", NULL };
+Boolean controlcaught = TRUE;
+
+/* escaping -- is this result an escape marker? */
+extern Boolean escaping(List *list) {
+	return list != NULL && list->term == &escapeterm;
+}
+
+/* escape -- raise an exception, or pass it back if the caller allows */
+extern List *escape(List *e, int flags) {
+	if ((flags & eval_escape)
+	    && (termeq(e->term, "return")
+		|| termeq(e->term, "break")
+		|| termeq(e->term, "continue")))
+		return mklist(&escapeterm, e);
+	throw(e);
+	NOTREACHED;
+}
+
+/*
+ * tail calls
+ *	eval() runs a call in tail position -- the body of a function
+ *	or thunk, or a command handed back by a primitive through
+ *	tailcall() -- by looping within its own frame instead of
+ *	recursing.  a lambda needs a frame of its own, to consume a
+ *	return and to bind $0, but only on entry:  a function which
+ *	tail calls another reuses the frame, and a return from either
+ *	ends it.
+ */
+
+typedef struct {
+	Push push;		/* the binding of $0, if pushed */
+	Boolean pushed;
+	Boolean fresh;		/* the frame's first lambda has not been entered */
+} Frame;
+
+static Term tailterm = { "", NULL };
+
+static List *evalloop(List *list0, Tree *tree0, Binding *binding0, int flags,
+		      char **funcnamep, Frame *frame);
+
+/* callfunction -- run a lambda in a frame which consumes return */
+static List *callfunction(List *list0, Binding *binding0, int flags,
+			  char **funcnamep) {
+	Frame frame;
+	Boolean caught = controlcaught;
 	Ref(List *, list, list0);
 	Ref(Binding *, binding, binding0);
-	Ref(char *, funcname, NULL);
+	frame.pushed = (*funcnamep != NULL);
+	frame.fresh = TRUE;
+
+	if (frame.pushed)
+		varpush(&frame.push, "0",
+			mklist(mkterm(*funcnamep, NULL), NULL));
+	controlcaught = FALSE;
+	list = evalloop(list, NULL, binding, flags | eval_escape,
+			funcnamep, &frame);
+	controlcaught = caught;
+	if (frame.pushed)
+		varpop(&frame.push);
+
+	if (escaping(list)) {
+		List *e = list->next;
+		if (termeq(e->term, "return"))
+			list = e->next;
+		else
+			list = escape(e, flags);
+	}
+
+	RefEnd(binding);
+	RefReturn(list);
+}
+
+/* boundary -- continue evalloop where a thrown escape must be caught */
+static List *boundary(List *list0, Tree *tree0, Binding *binding0, int flags,
+		      char **funcnamep, Frame *frame) {
+	Ref(List *, list, list0);
+	Ref(Tree *, tree, tree0);
+	Ref(Binding *, binding, binding0);
+
+	ExceptionHandler
+
+		controlcaught = TRUE;
+		list = evalloop(list, tree, binding, flags, funcnamep, frame);
+		controlcaught = FALSE;
+
+	CatchException (e)
+
+		list = escape(e, flags);
+
+	EndExceptionHandler
+
+	RefEnd2(binding, tree);
+	RefReturn(list);
+}
+
+/* evalloop -- the body of eval, which loops on calls in tail position */
+static List *evalloop(List *list0, Tree *tree0, Binding *binding0, int flags,
+		      char **funcnamep, Frame *frame) {
+	Closure *cp;
+	List *fn;
+	Prim *p;
+	int slot;
+	Boolean lexical;
+	Boolean guard = (flags & eval_escape) && !controlcaught;
+
+	Ref(List *, list, list0);
+	Ref(Binding *, binding, binding0);
+	Ref(Tree *, tree, tree0);
+	if (tree != NULL)
+		goto tail;
 
 restart:
 	SIGCHK();
+	if (gcexhausted) {
+		gcexhausted = FALSE;
+		fail("es:memory", "live data exceeds gc-max-heap");
+	}
 	if (list == NULL) {
-		RefPop3(funcname, binding, list);
-		--evaldepth;
-		return ltrue;
+		list = ltrue;
+		goto done;
 	}
 	assert(list->term != NULL);
 
@@ -383,41 +660,50 @@ restart:
 		switch (cp->tree->kind) {
 		    case nPrim:
 			assert(cp->binding == NULL);
-			list = prim(cp->tree->u[0].s, list->next, flags);
+			p = getprim(cp->tree->u[0].s);
+			if (!p->escapes && guard) {
+				list = boundary(list, NULL, binding, flags,
+						funcnamep, frame);
+				break;
+			}
+			list = (p->prim)(list->next,
+					 (p->escapes ? flags : flags &~ eval_escape)
+					 | eval_tailcall);
+			if (list != NULL && list->term == &tailterm) {
+				list = list->next;
+				binding = NULL;
+				*funcnamep = NULL;
+				goto restart;
+			}
 			break;
 		    case nThunk:
-			list = walk(cp->tree->u[0].p, cp->binding, flags);
-			break;
+			tree = cp->tree->u[0].p;
+			binding = cp->binding;
+			goto tail;
 		    case nLambda:
-			ExceptionHandler
-
-				Push p;
-				Ref(Tree *, tree, cp->tree);
-				Ref(Binding *, context,
-					       bindargs(tree->u[0].p,
-							list->next,
-							cp->binding));
-				if (funcname != NULL)
-					varpush(&p, "0",
-						    mklist(mkterm(funcname,
-								  NULL),
-							   NULL));
-				list = walk(tree->u[1].p, context, flags);
-				if (funcname != NULL)
-					varpop(&p);
-				RefEnd2(context, tree);
-	
-			CatchException (e)
-
-				if (termeq(e->term, "return")) {
-					list = e->next;
-					goto done;
-				}
-				throw(e);
-
-			EndExceptionHandler
-			break;
+			/* a named function can only reuse a frame which binds $0 */
+			if (frame == NULL
+			    || (*funcnamep != NULL && !frame->pushed)) {
+				list = callfunction(list, binding, flags,
+						    funcnamep);
+				break;
+			}
+			tree = cp->tree;
+			binding = bindargs(tree->u[0].p, list->next,
+					   cp->binding);
+			if (frame->fresh)
+				frame->fresh = FALSE;
+			else if (*funcnamep != NULL)
+				vardef("0", NULL,
+				       mklist(mkterm(*funcnamep, NULL), NULL));
+			tree = tree->u[1].p;
+			goto tail;
 		    case nList: {
+			if (guard && hascall(cp->tree)) {
+				list = boundary(list, NULL, binding, flags,
+						funcnamep, frame);
+				break;
+			}
 			Ref(List *, lp, glom(cp->tree, cp->binding, TRUE));
 			list = append(lp, list->next);
 			RefEnd(lp);
@@ -442,9 +728,16 @@ restart:
 	/* the logic here is duplicated in $&whatis */
 
 	Ref(char *, name, getstr(list->term));
-	fn = varlookup2("fn-", name, binding);
+	lexical = (binding != NULL && isbound2("fn-", name, binding));
+	if (!lexical && (slot = cmdcached(name)) != -1)
+		fn = cmdcache[slot].fn;
+	else {
+		fn = varlookup2("fn-", name, lexical ? binding : NULL);
+		if (!lexical)
+			cmdremember(name, fn);
+	}
 	if (fn != NULL) {
-		funcname = name;
+		*funcnamep = name;
 		list = append(fn, list->next);
 		RefPop(name);
 		goto restart;
@@ -453,8 +746,8 @@ restart:
 		char *error = checkexecutable(name);
 		if (error != NULL)
 			fail("$&whatis", "%s: %s", name, error);
-		if (funcname != NULL) {
-			Term *fn = mkstr(funcname);
+		if (*funcnamep != NULL) {
+			Term *fn = mkstr(*funcnamep);
 			list = mklist(fn, list->next);
 		}
 		list = forkexec(name, list, flags & eval_inchild);
@@ -463,25 +756,82 @@ restart:
 	}
 	RefEnd(name);
 
+	if (guard) {
+		list = boundary(list, NULL, binding, flags, funcnamep, frame);
+		goto done;
+	}
 	fn = pathsearch(list->term);
 	if (fn != NULL && fn->next == NULL
 	    && (cp = getclosure(fn->term)) == NULL) {
-		char *name = getstr(fn->term);
-		list = forkexec(name, list, flags & eval_inchild);
+		list = forkexec(getstr(fn->term), list, flags & eval_inchild);
 		goto done;
 	}
 
 	if (fn != NULL)
-		funcname = getstr(list->term);
+		*funcnamep = getstr(list->term);
 	list = append(fn, list->next);
 	goto restart;
 
+tail:
+	/* as walk() would, except that a call continues in this frame */
+	if (tree == NULL) {
+		list = ltrue;
+		goto done;
+	}
+	switch (tree->kind) {
+	    case nConcat: case nList: case nQword: case nVar: case nVarsub:
+	    case nWord: case nThunk: case nLambda: case nCall: case nPrim:
+		if (guard && hascall(tree)) {
+			list = boundary(NULL, tree, binding, flags,
+					funcnamep, frame);
+			break;
+		}
+		list = glom(tree, binding, TRUE);
+		*funcnamep = NULL;
+		goto restart;
+	    case nLet: case nClosure:
+		if (guard && hascall(tree->u[0].p)) {
+			list = boundary(NULL, tree, binding, flags,
+					funcnamep, frame);
+			break;
+		}
+		binding = letbindings(tree->u[0].p, binding, binding, flags);
+		tree = tree->u[1].p;
+		goto tail;
+	    default:
+		list = walk(tree, binding, flags);
+		break;
+	}
+
 done:
+	RefEnd2(tree, binding);
+	RefReturn(list);
+}
+
+/* eval -- evaluate a list, producing a list */
+extern List *eval(List *list0, Binding *binding0, int flags) {
+	List *list;
+
+	if (++evaldepth >= maxevaldepth)
+		fail("es:eval", "max-eval-depth exceeded");
+
+	Ref(char *, funcname, NULL);
+	if (gcprofiling)
+		gcprofframe(evaldepth, &funcname);
+	list = evalloop(list0, NULL, binding0, flags &~ eval_tailcall,
+			&funcname, NULL);
 	--evaldepth;
-	if ((flags & eval_exitonfalse) && !istrue(list))
+	if ((flags & eval_exitonfalse) && !escaping(list) && !istrue(list))
 		esexit(exitstatus(list));
-	RefEnd2(funcname, binding);
-	RefReturn(list);
+	RefEnd(funcname);
+	return list;
+}
+
+/* tailcall -- evaluate a list in place of the primitive which returns this */
+extern List *tailcall(List *list, int flags) {
+	if (flags & eval_tailcall)
+		return mklist(&tailterm, list);
+	return eval(list, NULL, flags);
 }
 
 /* eval1 -- evaluate a term, producing a list */
@@ -35,6 +35,7 @@ extern Noreturn throw(List *e) {
 		exceptionunroot();
 	}
 	evaldepth = handler->evaldepth;
+	controlcaught = handler->controlcaught;
 
 #if ASSERTIONS
 	for (; rootlist != handler->rootlist; rootlist = rootlist->next)
@@ -177,6 +177,48 @@ extern void closefds(void) {
 	}
 }
 
+#if USE_SPAWN
+/* deferof -- the deferred operation a reserved descriptor is the source of, or defcount */
+static int deferof(int *fdp) {
+	int i;
+	for (i = 0; i < defcount; i++)
+		if (fdp == &deftab[i].realfd)
+			break;
+	return i;
+}
+
+/*
+ * spawnfds -- express what closefds() would do in a child as spawn
+ *	file actions.  this cannot be done when a deferred operation
+ *	replaces a descriptor that es is still using, because releasefd()
+ *	would first have to move it to a number only known in the child.
+ */
+extern Boolean spawnfds(posix_spawn_file_actions_t *actions) {
+	int i, j;
+	for (i = 0; i < defcount; i++) {
+		Defer *defer = &deftab[i];
+		for (j = 0; j < rescount; j++)
+			if (*reserved[j].fdp == defer->userfd
+			    && deferof(reserved[j].fdp) > i)
+				return FALSE;
+		if (defer->realfd == -1) {
+			if (posix_spawn_file_actions_addclose(actions, defer->userfd) != 0)
+				return FALSE;
+		} else if (defer->realfd != defer->userfd)
+			if (posix_spawn_file_actions_adddup2(actions, defer->realfd, defer->userfd) != 0
+			    || posix_spawn_file_actions_addclose(actions, defer->realfd) != 0)
+				return FALSE;
+	}
+	for (i = 0; i < rescount; i++) {
+		Reserve *r = &reserved[i];
+		if (r->closeonfork && *r->fdp >= 3 && deferof(r->fdp) == defcount)
+			if (posix_spawn_file_actions_addclose(actions, *r->fdp) != 0)
+				return FALSE;
+	}
+	return TRUE;
+}
+#endif
+
 /* releasefd -- release a specific file descriptor from its es uses */
 extern void releasefd(int n) {
 	int i;
@@ -5,12 +5,23 @@
 #include "es.h"
 #include "gc.h"
 
+#if HAVE_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+
 #define	ALIGN(n)	(((n) + sizeof (void *) - 1) &~ (sizeof (void *) - 1))
 
 typedef struct Space Space;
 struct Space {
 	char *current, *bot, *top;
 	Space *next;
+#if !GCPROTECT
+	char *end;			/* end of the memory behind the space */
+#endif
+#if GCMOSTLYCOPY
+	Boolean pinned;			/* does the stack hold it in place? */
+	unsigned char *starts;		/* bitmap of the words where objects begin */
+#endif
 };
 
 #define	SPACESIZE(sp)	(((sp)->top - (sp)->bot))
@@ -18,8 +29,22 @@ struct Space {
 #define	SPACEUSED(sp)	(((sp)->current - (sp)->bot))
 #define	INSPACE(p, sp)	((sp)->bot <= (char *) (p) && (char *) (p) < (sp)->top)
 
+#if GCMOSTLYCOPY
+/* a string's size can't be recovered from its contents, so pinned spaces
+ * are walked using a bitmap of object starts, kept by gcalloc() */
+#define	STARTWORD(sp, p)	(((char *) (p) - (sp)->bot) / sizeof (void *))
+#define	STARTBYTES(size)	((size) / sizeof (void *) / 8 + 1)
+#define	SETSTART(sp, p)		((sp)->starts[STARTWORD(sp, p) / 8] |= 1 << (STARTWORD(sp, p) % 8))
+#endif
+
+#if GCGENERATIONAL
+#define	MIN_minspace	(128 * 1024)	/* the nursery */
+#define	MIN_majorspace	(512 * 1024)	/* tenured data before a full collection */
+#else
 #define	MIN_minspace	10000
+#endif
 #define	MIN_minpspace	1000
+#define	LARGEOBJECT	(16 * 1024)	/* objects this big are never copied */
 
 #if GCPROTECT
 #define	NSPACES		12
@@ -44,9 +69,36 @@ static Space *new, *old, *pspace;
 #if GCPROTECT
 static Space *spaces;
 #endif
+#if GCGENERATIONAL
+static Space *tenured;			/* objects which have survived a collection */
+static size_t majorspace = MIN_majorspace;	/* tenured bytes which provoke a full collection */
+static Boolean fullgc = FALSE;		/* next collection should be a full one */
+static void **remembered;		/* tenured objects which may point into the nursery */
+static size_t nremembered = 0, maxremembered = 0;
+#endif
 static Root *globalrootlist, *exceptionrootlist;
 static size_t minspace = MIN_minspace;	/* minimum number of bytes in a new space */
 static size_t minpspace = MIN_minpspace;
+static size_t floorspace = MIN_minspace;	/* minspace is never shrunk below this */
+static unsigned long maxpause = 0;	/* target pause in microseconds, or 0 */
+static unsigned long growth = 2;	/* the heap grows to this many times live data */
+static size_t maxheap = 0;		/* live bytes which raise es:memory, or 0 */
+static unsigned long throughput = 0;	/* measured bytes copied per microsecond */
+static Space *scanbase;			/* the space where copying began ... */
+static char *scanstart;			/* ... and the first copied object in it */
+static Space *perm = NULL;		/* the permanent region, see gcfreeze() */
+static void **permrefs;			/* permanent objects which may point into the heap */
+static size_t npermrefs = 0, maxpermrefs = 0;
+static void ***freezing;		/* pointers for the next collection to freeze */
+static size_t nfreezing = 0;
+static Boolean fmode = FALSE;		/* is the permanent region being filled? */
+#if GCMOSTLYCOPY
+static Space *pinned = NULL;		/* spaces the stack held in place last time */
+static void *stackbase;			/* the far end of the C stack */
+static Boolean pinhit;			/* did a scan reach a pinned object? */
+#endif
+static GCStats stats;			/* counters for $&gcstats */
+static size_t allocbase = 0;		/* bytes in new space not allocated by the mutator */
 
 
 /*
@@ -59,20 +111,38 @@ static size_t minpspace = MIN_minpspace;
 #define	VERBOSE(p)	NOP
 #endif
 
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #ifndef	MAP_ANONYMOUS
 #ifdef	MAP_ANON
 #define	MAP_ANONYMOUS	MAP_ANON
 #endif
 #endif
 
-#if GCPROTECT
-#if HAVE_MMAP
-#include <sys/mman.h>
+#if !GCPROTECT && HAVE_MMAP && defined(MAP_ANONYMOUS)
+#define	MAPSPACES	1	/* large spaces come straight from mmap */
+#else
+#define	MAPSPACES	0
 #endif
 
+#if GCPROTECT || MAPSPACES
 static int pagesize;
 #define	PAGEROUND(n)	((n) + pagesize - 1) &~ (pagesize - 1)
 
+/* initmmu -- initialization for memory management calls */
+static void initmmu(void) {
+#if HAVE_SYSCONF
+	pagesize = sysconf(_SC_PAGESIZE);
+#else
+	pagesize = getpagesize();
+#endif
+}
+#endif
+
+#if GCPROTECT
+
 /* take -- allocate memory for a space */
 static void *take(size_t n) {
 	void *addr;
@@ -121,14 +191,6 @@ static void revalidate(void *p, size_t n) {
 #endif
 }
 
-/* initmmu -- initialization for memory management calls */
-static void initmmu(void) {
-#if HAVE_SYSCONF
-	pagesize = sysconf(_SC_PAGESIZE);
-#else
-	pagesize = getpagesize();
-#endif
-}
 #endif	/* GCPROTECT */
 
 
@@ -185,14 +247,109 @@ static Space *mkspace(Space *space, Space *next, size_t size) {
 
 #else	/* !GCPROTECT */
 
+/*
+ * space pool
+ *	rather than freeing every space after a collection, deprecate()
+ *	keeps a few of them for newspacesz() to reuse.  large spaces are
+ *	mapped directly, so that while they sit unused in the pool, their
+ *	pages can be given back to the system.
+ */
+
+#define	MAPSPACE	(256 * 1024)	/* spaces at least this big are mmap'd */
+#define	NPOOL		8		/* maximum number of pooled spaces */
+
+static Space *pool = NULL;
+static int npool = 0;
+
+#define	ISMAPPED(sp)	(MAPSPACES && (size_t) ((sp)->end - (char *) (sp)) >= MAPSPACE)
+
+/* getspace -- get memory for a space and its header */
+static Space *getspace(size_t len) {
+	Space *space;
+#if MAPSPACES
+	if (len >= MAPSPACE) {
+		len = PAGEROUND(len);
+		space = mmap(0, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (space == MAP_FAILED)
+			panic("mmap: %s", esstrerror(errno));
+#if GCHUGEPAGES && defined(MADV_HUGEPAGE)
+		madvise((void *) space, len, MADV_HUGEPAGE);
+#endif
+	} else
+#endif
+		space = ealloc(len);
+	space->end = ((char *) space) + len;
+	return space;
+}
+
+/* freespace -- give a space's memory back */
+static void freespace(Space *space) {
+#if MAPSPACES
+	if (ISMAPPED(space)) {
+		if (munmap((void *) space, space->end - (char *) space) == -1)
+			panic("munmap: %s", esstrerror(errno));
+		return;
+	}
+#endif
+	efree(space);
+}
+
+/* poolspace -- put an unused space into the pool, or free it */
+static void poolspace(Space *space) {
+#if GCMOSTLYCOPY
+	efree(space->starts);
+	space->starts = NULL;
+#endif
+	if (npool >= NPOOL) {
+		freespace(space);
+		return;
+	}
+#if MAPSPACES && defined(MADV_DONTNEED)
+	if (ISMAPPED(space)) {
+		char *p = (char *) (PAGEROUND((size_t) space->bot));
+		if (p < space->end)
+			madvise((void *) p, space->end - p, MADV_DONTNEED);
+	}
+#endif
+	space->next = pool;
+	pool = space;
+	++npool;
+}
+
+/* unpool -- find a pooled space with room for n bytes, but not much more */
+static Space *unpool(size_t n) {
+	Space *space, **spp, **best = NULL;
+	size_t bestsize = 0;
+	for (spp = &pool; (space = *spp) != NULL; spp = &space->next) {
+		size_t size = space->end - (char *) &space[1];
+		if (n <= size && size <= n * 2 && (best == NULL || size < bestsize)) {
+			best = spp;
+			bestsize = size;
+		}
+	}
+	if (best == NULL)
+		return NULL;
+	space = *best;
+	*best = space->next;
+	--npool;
+	return space;
+}
+
 /* newspace -- create a new ``half'' space */
 static Space *newspacesz(Space *next, size_t size) {
 	size_t n = ALIGN(size);
-	Space *space = ealloc(sizeof (Space) + n);
+	Space *space = unpool(n);
+	if (space == NULL)
+		space = getspace(sizeof (Space) + n);
 	space->bot = (void *) &space[1];
 	space->top = (void *) (((char *) space->bot) + n);
 	space->current = space->bot;
 	space->next = next;
+#if GCMOSTLYCOPY
+	space->pinned = FALSE;
+	space->starts = ealloc(STARTBYTES(n));
+	memzero(space->starts, STARTBYTES(n));
+#endif
 	return space;
 }
 #define	newspace(next)		newspacesz(next, minspace)
@@ -223,7 +380,7 @@ static void deprecate(Space *space) {
 	while (space != NULL) {
 		Space *old = space;
 		space = space->next;
-		efree(old);
+		poolspace(old);
 	}
 
 #endif
@@ -239,6 +396,14 @@ extern Boolean isinspace(Space *space, void *p) {
 	return FALSE;
 }
 
+/* spaceused -- the number of bytes allocated in a chain of spaces */
+static size_t spaceused(Space *space) {
+	size_t used = 0;
+	for (; space != NULL; space = space->next)
+		used += SPACEUSED(space);
+	return used;
+}
+
 
 /*
  * root list building and scanning
@@ -281,6 +446,850 @@ extern void exceptionunroot(void) {
 #define	FOLLOWTO(p)	((Tag *) (((char *) p) + 1))
 #define	FOLLOW(tagp)	((void *) (((char *) tagp) - 1))
 
+
+/*
+ * large objects
+ *	objects of at least LARGEOBJECT bytes are allocated one at a time
+ *	and never move.  rather than copying them, the collector marks
+ *	those it reaches and frees the rest once it is done.  a large
+ *	object becomes old when it survives a collection; minor
+ *	collections leave old ones alone, just as they do tenured space.
+ */
+
+typedef struct Large Large;
+struct Large {
+	Large *next;			/* next large object of the same age */
+	Large *gray;			/* next marked object still to be scanned */
+	size_t size;			/* bytes allocated for the object */
+	Boolean marked, old;
+	/* followed by the object's tag and the object itself */
+};
+
+#define	LARGEOBJ(lp)	((void *) (((Tag **) &(lp)[1]) + 1))
+
+static Large *younglarge = NULL, *oldlarge = NULL;
+static size_t younglargesize = 0, oldlargesize = 0;
+static Large *gray = NULL;		/* marked objects which need scanning */
+static Boolean markold = TRUE;		/* does this collection mark old objects? */
+static Large **largetab = NULL;		/* hash table of all large objects */
+static size_t largetabsize = 0, nlarge = 0;
+
+#define	LARGEHASH(p)	((((size_t) (p)) >> 12 ^ ((size_t) (p)) >> 4) & (largetabsize - 1))
+
+/* largeinsert -- add a large object to the hash table */
+static void largeinsert(Large *lp) {
+	size_t h;
+	if ((nlarge + 1) * 2 > largetabsize) {
+		size_t i, oldsize = largetabsize;
+		Large **oldtab = largetab;
+		largetabsize = (oldsize == 0) ? 64 : oldsize * 2;
+		largetab = ealloc(largetabsize * sizeof (Large *));
+		memzero(largetab, largetabsize * sizeof (Large *));
+		nlarge = 0;
+		for (i = 0; i < oldsize; i++)
+			if (oldtab[i] != NULL)
+				largeinsert(oldtab[i]);
+		if (oldtab != NULL)
+			efree(oldtab);
+	}
+	for (h = LARGEHASH(LARGEOBJ(lp)); largetab[h] != NULL; h = (h + 1) & (largetabsize - 1))
+		;
+	largetab[h] = lp;
+	++nlarge;
+}
+
+/* largeof -- return the header of a large object, or NULL if p isn't one */
+static Large *largeof(const void *p) {
+	size_t h;
+	Large *lp;
+	if (nlarge == 0)
+		return NULL;
+	for (h = LARGEHASH(p); (lp = largetab[h]) != NULL; h = (h + 1) & (largetabsize - 1))
+		if (LARGEOBJ(lp) == p)
+			return lp;
+	return NULL;
+}
+
+/* marklarge -- note that a collection reached p, if it is a large object */
+static void marklarge(void *p) {
+	Large *lp = largeof(p);
+	if (lp == NULL || lp->marked || (lp->old && !markold))
+		return;
+	VERBOSE(("GC %8ux : %s	marked\n", p, TAG(p)->typename));
+	lp->marked = TRUE;
+	lp->gray = gray;
+	gray = lp;
+}
+
+/* scanlarge -- scan the marked large objects; return whether there were any */
+static Boolean scanlarge(void) {
+	Large *lp;
+	if (gray == NULL)
+		return FALSE;
+	while ((lp = gray) != NULL) {
+		void *p = LARGEOBJ(lp);
+		gray = lp->gray;
+		VERBOSE(("GC %8ux : %s	scan large\n", p, TAG(p)->typename));
+		(*TAG(p)->scan)(p);
+	}
+	return TRUE;
+}
+
+/* sweeplarge -- free unmarked objects and age the rest; return the bytes kept */
+static size_t sweeplarge(void) {
+	size_t i, live = 0;
+	Large *lp, *next, *lists[2];
+
+	lists[0] = younglarge;
+	lists[1] = markold ? oldlarge : NULL;
+	if (markold) {
+		oldlarge = NULL;
+		oldlargesize = 0;
+	}
+	younglarge = NULL;
+	younglargesize = 0;
+	for (i = 0; i < 2; i++)
+		for (lp = lists[i]; lp != NULL; lp = next) {
+			next = lp->next;
+			if (lp->marked) {
+				lp->marked = FALSE;
+				lp->old = TRUE;
+				lp->next = oldlarge;
+				oldlarge = lp;
+				oldlargesize += lp->size;
+				live += lp->size;
+			} else
+				efree(lp);
+		}
+
+	if (largetab != NULL)
+		memzero(largetab, largetabsize * sizeof (Large *));
+	nlarge = 0;
+	for (lp = oldlarge; lp != NULL; lp = lp->next)
+		largeinsert(lp);
+	return live;
+}
+
+/* largealloc -- allocate an object which will never be moved */
+static void *largealloc(size_t nbytes, Tag *tag) {
+	Large *lp;
+	void *p;
+	if (!gcblocked && younglargesize > minspace)
+		gc();
+	lp = ealloc(sizeof (Large) + sizeof (Tag *) + nbytes);
+	lp->size = nbytes;
+	lp->old = FALSE;
+	lp->next = younglarge;
+	younglarge = lp;
+	younglargesize += nbytes;
+	stats.allocated += nbytes;
+	largeinsert(lp);
+	p = LARGEOBJ(lp);
+	TAG(p) = tag;
+	/* objects copied during a collection must survive it */
+	lp->marked = (old != NULL);
+	if (lp->marked) {
+		lp->gray = gray;
+		gray = lp;
+	}
+	return p;
+}
+
+
+/*
+ * cells
+ *	with GCBIBOP, the small objects which make up most of the heap
+ *	(see the cell types in gc.h) are kept in pages which hold objects
+ *	of just one type.  the page supplies the tag, so these cells have
+ *	no header word, and bitmaps in the page take the place of the
+ *	forwarding and remembered bits kept in other objects' tags.
+ *	pages are aligned, so a cell's page is found by masking its
+ *	address; a hash table of every page tells cells from other
+ *	pointers.  pages are carved out of chunks which are never freed,
+ *	but unused pages are reused.
+ */
+
+#if GCBIBOP
+#define	CELLPAGE	4096		/* bytes per page, a power of 2 */
+#define	CHUNKPAGES	64		/* pages allocated at a time */
+#define	MAXCELLS	(CELLPAGE / (2 * sizeof (void *)))
+#define	BITMAPSIZE	((MAXCELLS + 7) / 8)
+
+typedef enum { pageFree, pageYoung, pageOld } PageAge;
+
+typedef struct Page Page;
+struct Page {
+	Page *next;			/* next page of the same age */
+	Page *scannext;			/* next filled page with cells to scan */
+	Tag *tag;			/* the tag of every cell in the page */
+	size_t size;			/* bytes per cell */
+	char *current, *top;		/* first free cell, end of the page */
+	char *scan;			/* first cell a collection has not scanned */
+	PageAge age;
+	Boolean from;			/* is the page being collected? */
+	unsigned char forwarded[BITMAPSIZE];
+	unsigned char remembered[BITMAPSIZE];
+};
+
+#define	CELLS(pg)		(((char *) (pg)) + ALIGN(sizeof (Page)))
+#define	CELLINDEX(pg, p)	((size_t) (((char *) (p) - CELLS(pg)) / (pg)->size))
+#define	TESTBIT(map, i)		((map)[(i) >> 3] & (1 << ((i) & 7)))
+#define	SETBIT(map, i)		((map)[(i) >> 3] |= (1 << ((i) & 7)))
+#define	CLEARBIT(map, i)	((map)[(i) >> 3] &= ~(1 << ((i) & 7)))
+#define	PAGEHASH(pg)		((((size_t) (pg)) / CELLPAGE) & (pagetabsize - 1))
+
+static struct {
+	Page *alloc;			/* where the shell allocates new cells */
+	Page *copy;			/* where a collection copies cells */
+} cells[NCELLTYPES];
+
+static Page **pagetab = NULL;		/* hash table of every page */
+static size_t pagetabsize = 0, npages = 0;
+static char *pagelo = NULL, *pagehi = NULL;	/* bounds of all chunks */
+static Page *freepages = NULL;
+static Page *youngpages = NULL, *oldpages = NULL, *topages = NULL;
+static size_t nyoungpages = 0, noldpages = 0, ntopages = 0;
+static Page *scanpages = NULL;		/* filled pages still to be scanned */
+static size_t cellcopied = 0;		/* cell bytes copied by this collection */
+
+#define	CELLSFULL()	(nyoungpages * CELLPAGE >= minspace)
+
+/* pageinsert -- add a page to the hash table */
+static void pageinsert(Page *pg) {
+	size_t h;
+	if ((npages + 1) * 2 > pagetabsize) {
+		size_t i, oldsize = pagetabsize;
+		Page **oldtab = pagetab;
+		pagetabsize = (oldsize == 0) ? 256 : oldsize * 2;
+		pagetab = ealloc(pagetabsize * sizeof (Page *));
+		memzero(pagetab, pagetabsize * sizeof (Page *));
+		npages = 0;
+		for (i = 0; i < oldsize; i++)
+			if (oldtab[i] != NULL)
+				pageinsert(oldtab[i]);
+		if (oldtab != NULL)
+			efree(oldtab);
+	}
+	for (h = PAGEHASH(pg); pagetab[h] != NULL; h = (h + 1) & (pagetabsize - 1))
+		;
+	pagetab[h] = pg;
+	++npages;
+}
+
+/* pageof -- return the page holding a cell, or NULL if p isn't a cell */
+static Page *pageof(const void *p) {
+	size_t h;
+	Page *pg, *base;
+	if ((char *) p < pagelo || (char *) p >= pagehi)
+		return NULL;
+	base = (Page *) (((size_t) p) &~ (CELLPAGE - 1));
+	for (h = PAGEHASH(base); (pg = pagetab[h]) != NULL; h = (h + 1) & (pagetabsize - 1))
+		if (pg == base)
+			return (pg->age == pageFree) ? NULL : pg;
+	return NULL;
+}
+
+/* getpage -- take a page off the free list, allocating a chunk if need be */
+static Page *getpage(void) {
+	Page *pg;
+	if (freepages == NULL) {
+		int i;
+		char *chunk = ealloc(CHUNKPAGES * CELLPAGE + CELLPAGE - 1);
+		chunk = (char *) ((((size_t) chunk) + CELLPAGE - 1) &~ (CELLPAGE - 1));
+		if (pagelo == NULL || chunk < pagelo)
+			pagelo = chunk;
+		if (chunk + CHUNKPAGES * CELLPAGE > pagehi)
+			pagehi = chunk + CHUNKPAGES * CELLPAGE;
+		for (i = CHUNKPAGES; i-- > 0;) {
+			pg = (Page *) (chunk + i * CELLPAGE);
+			pg->age = pageFree;
+			pg->next = freepages;
+			freepages = pg;
+			pageinsert(pg);
+		}
+	}
+	pg = freepages;
+	freepages = pg->next;
+	memzero(pg, sizeof (Page));
+	pg->current = pg->scan = CELLS(pg);
+	pg->top = ((char *) pg) + CELLPAGE;
+	return pg;
+}
+
+/* freepagelist -- return a list of pages to the free list */
+static void freepagelist(Page *pg) {
+	Page *next;
+	for (; pg != NULL; pg = next) {
+		next = pg->next;
+#if GCPROTECT
+		memset(CELLS(pg), 0x5e, pg->top - CELLS(pg));
+#endif
+		pg->age = pageFree;
+		pg->next = freepages;
+		freepages = pg;
+	}
+}
+
+/* cellalloc -- allocate a cell, either for the shell or for a collection */
+static void *cellalloc(size_t nbytes, Tag *tag) {
+	Page *pg;
+	char *p;
+	Boolean collecting = (old != NULL);
+
+	pg = collecting ? cells[tag->cell].copy : cells[tag->cell].alloc;
+	if (pg == NULL || pg->current + pg->size > pg->top) {
+		if (!collecting && !gcblocked && CELLSFULL()) {
+			gc();
+			return cellalloc(nbytes, tag);
+		}
+		if (collecting && pg != NULL) {
+			/* a full page is not filled any further, so it can be
+			 * scanned once; the current page is checked separately */
+			pg->scannext = scanpages;
+			scanpages = pg;
+		}
+		pg = getpage();
+		pg->tag = tag;
+		pg->size = ALIGN(nbytes);
+		if (collecting) {
+			pg->age = pageOld;
+			pg->next = topages;
+			topages = pg;
+			++ntopages;
+			cells[tag->cell].copy = pg;
+		} else {
+			pg->age = pageYoung;
+			pg->next = youngpages;
+			youngpages = pg;
+			++nyoungpages;
+			cells[tag->cell].alloc = pg;
+		}
+	}
+	assert(pg->tag == tag && pg->size == ALIGN(nbytes));
+
+	p = pg->current;
+	pg->current += pg->size;
+	if (collecting)
+		cellcopied += pg->size;
+	else
+		stats.allocated += pg->size;
+	return p;
+}
+
+/* forwardcell -- copy a cell out of a page being collected */
+static void *forwardcell(Page *pg, void *p) {
+	size_t i = CELLINDEX(pg, p);
+	void *np;
+	if (TESTBIT(pg->forwarded, i)) {
+		np = *(void **) p;
+		VERBOSE(("GC %8ux : %s	-> %8ux (followed)\n", p, pg->tag->typename, np));
+	} else {
+		np = (*pg->tag->copy)(p);
+		VERBOSE(("GC %8ux : %s	-> %8ux (forwarded)\n", p, pg->tag->typename, np));
+		SETBIT(pg->forwarded, i);
+		*(void **) p = np;
+	}
+	return np;
+}
+
+/* scanpage -- scan the cells of a page which a collection has copied */
+static Boolean scanpage(Page *pg) {
+	size_t (*scan)(void *) = pg->tag->scan;
+	size_t size = pg->size;
+	if (pg->scan >= pg->current)
+		return FALSE;
+	do {
+		char *p = pg->scan;
+		pg->scan += size;
+		VERBOSE(("GC %8ux : %s	scan\n", p, pg->tag->typename));
+		(*scan)(p);
+	} while (pg->scan < pg->current);
+	return TRUE;
+}
+
+/* scancells -- scan copied cells; return whether there were any */
+static Boolean scancells(void) {
+	int i;
+	Page *pg;
+	Boolean any = FALSE;
+	for (;;) {
+		Boolean progress = FALSE;
+		while ((pg = scanpages) != NULL) {
+			scanpages = pg->scannext;
+			progress |= scanpage(pg);
+		}
+		for (i = 0; i < NCELLTYPES; i++)
+			if ((pg = cells[i].copy) != NULL)
+				progress |= scanpage(pg);
+		if (!progress)
+			return any;
+		any = TRUE;
+	}
+}
+
+/* startcells -- prepare the pages for a collection */
+static void startcells(Boolean major) {
+	int i;
+	Page *pg;
+	for (pg = youngpages; pg != NULL; pg = pg->next)
+		pg->from = TRUE;
+	if (major)
+		for (pg = oldpages; pg != NULL; pg = pg->next)
+			pg->from = TRUE;
+	for (i = 0; i < NCELLTYPES; i++) {
+		cells[i].alloc = NULL;
+		if (major)
+			cells[i].copy = NULL;
+		else if ((pg = cells[i].copy) != NULL)
+			pg->scan = pg->current;
+	}
+	topages = scanpages = NULL;
+	ntopages = 0;
+	cellcopied = 0;
+}
+
+/* endcells -- free the collected pages; return the cell bytes copied */
+static size_t endcells(Boolean major) {
+	Page *pg;
+	assert(scanpages == NULL);
+	freepagelist(youngpages);
+	youngpages = NULL;
+	nyoungpages = 0;
+	if (major) {
+		freepagelist(oldpages);
+		oldpages = NULL;
+		noldpages = 0;
+	}
+	if (topages != NULL) {
+		for (pg = topages; pg->next != NULL; pg = pg->next)
+			;
+		pg->next = oldpages;
+		oldpages = topages;
+		noldpages += ntopages;
+		topages = NULL;
+		ntopages = 0;
+	}
+	return cellcopied;
+}
+
+/* tagof -- find the tag of any object */
+static Tag *tagof(void *p) {
+	Page *pg = pageof(p);
+	return (pg != NULL) ? pg->tag : TAG(p);
+}
+#else
+#define	CELLSFULL()	FALSE
+#define	tagof(p)	TAG(p)
+#define	startcells(major)	NOP
+#define	endcells(major)	0
+#define	nyoungpages	0
+#define	noldpages	0
+#define	CELLPAGE	0
+#endif
+
+/* objects in a remembered set have the second bit of their tag set */
+#define	REMEMBERED(tagp)	(((size_t) tagp) & 2)
+#define	REMEMBER(tagp)		((Tag *) (((size_t) tagp) | 2))
+#define	FORGET(tagp)		((Tag *) (((size_t) tagp) &~ 2))
+
+
+/*
+ * the permanent region
+ *	gcfreeze() moves data which is expected to live for the rest of
+ *	the shell's life, such as library functions, into a region which
+ *	is never collected.  like dump.c's static data, the collector
+ *	neither copies nor scans it, except for those permanent objects
+ *	which the write barrier notes have since been pointed into the heap.
+ */
+
+/* permremember -- note that a permanent object may point into the heap */
+static void permremember(void *p) {
+	Tag *tag = TAG(p);
+	if (REMEMBERED(tag))
+		return;
+	if (npermrefs >= maxpermrefs) {
+		maxpermrefs = (maxpermrefs == 0) ? 64 : maxpermrefs * 2;
+		permrefs = erealloc(permrefs, maxpermrefs * sizeof (void *));
+	}
+	permrefs[npermrefs++] = p;
+	TAG(p) = REMEMBER(tag);
+}
+
+/* scanpermrefs -- forward the heap pointers held by permanent objects */
+static void scanpermrefs(void) {
+	size_t i;
+	for (i = 0; i < npermrefs; i++) {
+		void *p = permrefs[i];
+		Tag *tag = FORGET(TAG(p));
+		VERBOSE(("GC %8ux : %s	permanent\n", p, tag->typename));
+		(*tag->scan)(p);
+	}
+}
+
+#if GCGENERATIONAL
+/* isyoung -- has an object been allocated since the last collection? */
+static Boolean isyoung(const void *p) {
+	Large *lp;
+#if GCBIBOP
+	Page *pg = pageof(p);
+	if (pg != NULL)
+		return pg->age == pageYoung;
+#endif
+	return isinspace(new, (void *) p) || ((lp = largeof(p)) != NULL && !lp->old);
+}
+
+/* isold -- has an object survived a collection? */
+static Boolean isold(void *p) {
+	Large *lp;
+#if GCBIBOP
+	Page *pg = pageof(p);
+	if (pg != NULL)
+		return pg->age == pageOld;
+#endif
+	return isinspace(tenured, p) || ((lp = largeof(p)) != NULL && lp->old);
+}
+
+/* remember -- set or clear an object's remembered bit, returning the old tag */
+static Tag *remember(void *p, Boolean set) {
+	Tag *tag;
+#if GCBIBOP
+	Page *pg = pageof(p);
+	if (pg != NULL) {
+		size_t i = CELLINDEX(pg, p);
+		tag = TESTBIT(pg->remembered, i) ? REMEMBER(pg->tag) : pg->tag;
+		if (set)
+			SETBIT(pg->remembered, i);
+		else
+			CLEARBIT(pg->remembered, i);
+		return tag;
+	}
+#endif
+	tag = TAG(p);
+	TAG(p) = set ? REMEMBER(tag) : FORGET(tag);
+	return tag;
+}
+
+/* gcremember -- the write barrier: note that p may now point at value */
+extern void gcremember(void *p, const void *value) {
+	if (value == NULL || old != NULL)
+		return;
+	if (perm != NULL && isinspace(perm, p)) {
+		if (!isinspace(perm, (void *) value))
+			permremember(p);
+		return;
+	}
+	if (
+		   !isyoung(value)
+		|| !isold(p)
+		|| REMEMBERED(remember(p, TRUE))
+	)
+		return;
+	if (nremembered >= maxremembered) {
+		maxremembered = (maxremembered == 0) ? 64 : maxremembered * 2;
+		remembered = erealloc(remembered, maxremembered * sizeof (void *));
+	}
+	remembered[nremembered++] = p;
+}
+
+/* scanremembered -- forward nursery pointers held by tenured objects */
+static void scanremembered(void) {
+	size_t i;
+	for (i = 0; i < nremembered; i++) {
+		void *p = remembered[i];
+		Tag *tag = FORGET(remember(p, FALSE));
+		assert(tag->magic == TAGMAGIC);
+		VERBOSE(("GC %8ux : %s	remembered\n", p, tag->typename));
+		(*tag->scan)(p);
+	}
+	nremembered = 0;
+}
+
+/* forgetremembered -- empty the remembered set before a full collection */
+static void forgetremembered(void) {
+	size_t i;
+	for (i = 0; i < nremembered; i++)
+		remember(remembered[i], FALSE);
+	nremembered = 0;
+}
+#else
+/* gcremember -- the write barrier: note that p may now point at value */
+extern void gcremember(void *p, const void *value) {
+	if (value != NULL && old == NULL && perm != NULL && isinspace(perm, p) && !isinspace(perm, (void *) value))
+		permremember(p);
+}
+#endif
+
+#if GCMOSTLYCOPY
+/*
+ * conservative stack scanning
+ *	in the mostly-copying mode, Ref() does not describe the C stack to
+ *	the collector.  instead, any word on the stack or in a register which
+ *	points into the allocated part of an old space pins that space: it
+ *	is kept where it is for another cycle, and all of its objects are
+ *	scanned as roots.  everything not reachable only from the stack is
+ *	still copied, precisely.
+ */
+
+#if !__GNUC__
+void *volatile refsink;			/* see refescape() in es.h */
+#endif
+
+/* gcsetstack -- note the base of the C stack, above main's frame */
+extern void gcsetstack(void *base) {
+	stackbase = base;
+}
+
+/* ispinned -- does p lie in an old space which the stack holds in place? */
+static Boolean ispinned(void *p) {
+	Space *sp;
+	for (sp = old; sp != NULL; sp = sp->next)
+		if (INSPACE(p, sp))
+			return sp->pinned;
+	return FALSE;
+}
+
+/* pinword -- pin anything a word from the stack might point at */
+static void pinword(void *p) {
+	Space *sp;
+	for (sp = old; sp != NULL; sp = sp->next)
+		if (sp->bot <= (char *) p && (char *) p < sp->current) {
+			sp->pinned = TRUE;
+			return;
+		}
+	marklarge(p);
+}
+
+/* pinrange -- pin from every word between here and the base of the stack */
+#if __GNUC__
+__attribute__((noinline))
+#endif
+static void pinrange(void) {
+	void *here = &here;
+	void **lo = here, **hi = stackbase, **wp;
+	if (lo > hi) {
+		wp = lo;
+		lo = hi;
+		hi = wp;
+	}
+	for (wp = lo; wp < hi; wp++)
+		pinword(*wp);
+}
+
+/* pinstack -- pin what the C stack and registers refer to */
+static void pinstack(void) {
+	jmp_buf regs;
+	assert(stackbase != NULL);
+#if __GNUC__
+	__builtin_unwind_init();	/* spill callee-saved registers */
+#endif
+	setjmp(regs);
+	pinrange();
+}
+
+/* scanpinned -- scan every object in the pinned spaces */
+static void scanpinned(void) {
+	Space *sp;
+	for (sp = old; sp != NULL; sp = sp->next)
+		if (sp->pinned) {
+			size_t i, n = STARTWORD(sp, sp->current);
+			VERBOSE(("GC pinned space = %ux ... %ux\n", sp->bot, sp->current));
+			for (i = 0; i < n; i++)
+				if (sp->starts[i / 8] == 0)
+					i |= 7;
+				else if (sp->starts[i / 8] & (1 << (i % 8))) {
+					Tag **tp = (Tag **) sp->bot + i;
+					Tag *tag = FORGET(*tp);
+					assert(tag->magic == TAGMAGIC);
+					(*tag->scan)(tp + 1);
+				}
+		}
+}
+
+/* unpin -- take the pinned spaces out of old space, to be collected next time */
+static void unpin(void) {
+	Space *sp, **spp;
+	for (spp = &old; (sp = *spp) != NULL;)
+		if (sp->pinned) {
+			sp->pinned = FALSE;
+			*spp = sp->next;
+			sp->next = pinned;
+			pinned = sp;
+		} else
+			spp = &sp->next;
+}
+#endif
+
+/*
+ * the heap census
+ *	gccensus() walks everything reachable from the roots without
+ *	moving it:  in cmode, forward() just notes each pointer it is
+ *	handed, so the tags' scan functions enumerate an object's
+ *	children.  objects are attributed to the first named root
+ *	which reaches them, so each variable is charged with what it
+ *	holds that no earlier variable does.
+ */
+
+static Boolean cmode = FALSE;		/* is a census being taken? */
+static void **seen = NULL;		/* open hash of objects already noted */
+static size_t nseen, seensize;
+static void **census;			/* objects noted but not yet scanned */
+static size_t ncensus, maxcensus;
+static GCCensus *ctypes;		/* where the counts go ... */
+static int nctypes, ntype;
+static GCLargest *clargest;		/* ... and the largest objects */
+static int nclargest;
+
+#define	SEENHASH(p, size)	((((size_t) (p)) >> 3) * 2654435761UL & ((size) - 1))
+
+/* isheap -- is p an object in the collected heap? */
+static Boolean isheap(void *p) {
+#if GCBIBOP
+	if (pageof(p) != NULL)
+		return TRUE;
+#endif
+	if (largeof(p) != NULL || isinspace(new, p) || isinspace(perm, p))
+		return TRUE;
+#if GCGENERATIONAL
+	if (isinspace(tenured, p))
+		return TRUE;
+#endif
+#if GCMOSTLYCOPY
+	if (isinspace(pinned, p))
+		return TRUE;
+#endif
+	return FALSE;
+}
+
+/* censusnote -- queue a heap object for the census, unless it has been seen */
+static void censusnote(void *p) {
+	size_t h;
+	if (p == NULL)
+		return;
+	if (nseen * 2 >= seensize) {
+		size_t i, oldsize = seensize;
+		void **oldseen = seen;
+		seensize = (seensize == 0) ? 1024 : seensize * 2;
+		seen = ealloc(seensize * sizeof (void *));
+		memzero(seen, seensize * sizeof (void *));
+		for (i = 0; i < oldsize; i++)
+			if (oldseen[i] != NULL) {
+				for (h = SEENHASH(oldseen[i], seensize); seen[h] != NULL; h = (h + 1) & (seensize - 1))
+					;
+				seen[h] = oldseen[i];
+			}
+		if (oldseen != NULL)
+			efree(oldseen);
+	}
+	for (h = SEENHASH(p, seensize); seen[h] != NULL; h = (h + 1) & (seensize - 1))
+		if (seen[h] == p)
+			return;
+	if (!isheap(p))
+		return;
+	seen[h] = p;
+	++nseen;
+	if (ncensus >= maxcensus) {
+		maxcensus = (maxcensus == 0) ? 256 : maxcensus * 2;
+		census = erealloc(census, maxcensus * sizeof (void *));
+	}
+	census[ncensus++] = p;
+}
+
+/* censustop -- keep the n biggest entries of top in order */
+static void censustop(GCLargest top[], int n, char *type, char *var, unsigned long bytes) {
+	int i;
+	if (n == 0 || bytes <= top[n - 1].bytes)
+		return;
+	for (i = n - 1; i > 0 && bytes > top[i - 1].bytes; i--)
+		top[i] = top[i - 1];
+	top[i].type = type;
+	top[i].var = var;
+	top[i].bytes = bytes;
+}
+
+/* censusscan -- count the queued objects and whatever they reach, returning their size */
+static unsigned long censusscan(char *var) {
+	unsigned long total = 0;
+	while (ncensus > 0) {
+		int i;
+		unsigned long size;
+		void *p = census[--ncensus];
+		Tag *tag = FORGET(tagof(p));
+		assert(tag->magic == TAGMAGIC);
+		size = ALIGN((*tag->scan)(p));
+#if GCBIBOP
+		if (pageof(p) == NULL)
+#endif
+			size += sizeof (Tag *);	/* cells in pages have no header */
+		total += size;
+		for (i = 0; i < ntype; i++)
+			if (ctypes[i].type == tag->typename)
+				break;
+		if (i == ntype && ntype < nctypes) {
+			ctypes[i].type = tag->typename;
+			ctypes[i].count = ctypes[i].bytes = 0;
+			++ntype;
+		}
+		if (i < ntype) {
+			++ctypes[i].count;
+			ctypes[i].bytes += size;
+		}
+		censustop(clargest, nclargest, tag->typename, var, size);
+	}
+	return total;
+}
+
+/* gccensus -- count the live objects of each type, and find the largest objects and holders */
+extern int gccensus(char *names[], void *roots[], size_t n,
+		    GCCensus types[], int ntypes,
+		    GCLargest largest[], int nlargest,
+		    GCLargest holders[], int nholders) {
+	int i;
+	size_t r;
+	Root *root, *rootlists[3];
+
+	assert(!cmode);
+	for (i = 0; i < nlargest; i++) {
+		largest[i].type = largest[i].var = NULL;
+		largest[i].bytes = 0;
+	}
+	for (i = 0; i < nholders; i++) {
+		holders[i].type = holders[i].var = NULL;
+		holders[i].bytes = 0;
+	}
+	ctypes = types;
+	nctypes = ntypes;
+	ntype = 0;
+	clargest = largest;
+	nclargest = nlargest;
+	nseen = seensize = 0;
+	ncensus = maxcensus = 0;
+	seen = NULL;
+	census = NULL;
+	++gcblocked;
+	cmode = TRUE;
+
+	for (r = 0; r < n; r++) {
+		censusnote(roots[r]);
+		censustop(holders, nholders, NULL, names[r], censusscan(names[r]));
+	}
+	rootlists[0] = rootlist;
+	rootlists[1] = globalrootlist;
+	rootlists[2] = exceptionrootlist;
+	for (i = 0; i < 3; i++)
+		for (root = rootlists[i]; root != NULL; root = root->next) {
+			censusnote(*root->p);
+			censusscan(NULL);
+		}
+
+	cmode = FALSE;
+	--gcblocked;
+	if (seen != NULL)
+		efree(seen);
+	if (census != NULL)
+		efree(census);
+	return ntype;
+}
+
 /* TODO: remove pmode: it's the Wrong Thing */
 static Boolean pmode = FALSE;
 
@@ -288,15 +1297,53 @@ static Boolean pmode = FALSE;
 extern void *forward(void *p) {
 	Tag *tag;
 	void *np;
+	Large *lp;
+
+	if (cmode) {
+		censusnote(p);
+		return p;
+	}
 
 	if (pmode && !isinspace(pspace, p)) {
 		VERBOSE(("GC %8ux : <<not in pspace>>\n", p));
 		return p;
 	}
 
-	if (!pmode && !isinspace(old, p)) {
-		VERBOSE(("GC %8ux : <<not in old space>>\n", p));
-		return p;
+	if (!pmode) {
+#if GCBIBOP
+		Page *pg = pageof(p);
+		if (pg != NULL)
+			return pg->from ? forwardcell(pg, p) : p;
+#endif
+		if (!isinspace(old, p)) {
+			VERBOSE(("GC %8ux : <<not in old space>>\n", p));
+			if ((lp = largeof(p)) != NULL) {
+				tag = TAG(p);
+				if (FORWARDED(tag))	/* already frozen */
+					return FOLLOW(tag);
+				if (fmode) {
+#if GCMOSTLYCOPY
+					if (lp->marked) {	/* held by the stack */
+						pinhit = TRUE;
+						return p;
+					}
+#endif
+					np = (*FORGET(tag)->copy)(p);
+					TAG(p) = FOLLOWTO(np);
+					return np;
+				}
+			}
+			marklarge(p);
+			return p;
+		}
+#if GCMOSTLYCOPY
+		if (ispinned(p)) {
+			VERBOSE(("GC %8ux : <<pinned>>\n", p));
+			if (fmode)
+				pinhit = TRUE;
+			return p;
+		}
+#endif
 	}
 
 	VERBOSE(("GC %8ux : ", p));
@@ -305,8 +1352,8 @@ extern void *forward(void *p) {
 	assert(tag != NULL);
 	if (FORWARDED(tag)) {
 		np = FOLLOW(tag);
-		assert(TAG(np)->magic == TAGMAGIC);
-		VERBOSE(("%s	-> %8ux (followed)\n", TAG(np)->typename, np));
+		assert(FORGET(tagof(np))->magic == TAGMAGIC);	/* it may be a remembered permanent object */
+		VERBOSE(("%s	-> %8ux (followed)\n", FORGET(tagof(np))->typename, np));
 	} else {
 		assert(tag->magic == TAGMAGIC);
 		np = (*tag->copy)(p);
@@ -315,7 +1362,7 @@ extern void *forward(void *p) {
 	}
 
 	if (pmode) {
-		tag = TAG(np);
+		tag = tagof(np);
 		(*tag->scan)(np);
 	}
 
@@ -331,29 +1378,406 @@ static void scanroots(Root *rootlist) {
 	}
 }
 
-/* scanspace -- scan new space until it is up to date */
+/* scanspace -- scan new space and large objects until they are up to date */
 static void scanspace(void) {
-	Space *sp, *scanned;
-	for (scanned = NULL;;) {
-		Space *front = new;
-		for (sp = new; sp != scanned; sp = sp->next) {
-			char *scan;
-			assert(sp != NULL);
-			scan = sp->bot;
-			while (scan < sp->current) {
-				Tag *tag = *(Tag **) scan;
-				assert(tag->magic == TAGMAGIC);
-				scan += sizeof (Tag *);
-				VERBOSE(("GC %8ux : %s	scan\n", scan, tag->typename));
-				scan += ALIGN((*tag->scan)(scan));
+	Space *sp = scanbase;
+	char *scan = scanstart;
+	for (;;) {
+		while (scan < sp->current) {
+			Tag *tag = *(Tag **) scan;
+			assert(tag->magic == TAGMAGIC);
+			scan += sizeof (Tag *);
+			VERBOSE(("GC %8ux : %s	scan\n", scan, tag->typename));
+#if GCMOSTLYCOPY
+			/* a frozen object which points at a pinned one must be
+			 * scanned again by later collections */
+			pinhit = FALSE;
+			{
+				char *obj = scan;
+				scan += ALIGN((*tag->scan)(obj));
+				if (pinhit)
+					permremember(obj);
 			}
+#else
+			scan += ALIGN((*tag->scan)(scan));
+#endif
 		}
-		if (new == front)
+		if (scanlarge())
+			continue;
+#if GCBIBOP
+		if (scancells())
+			continue;
+#endif
+		if (sp == new)
 			break;
-		scanned = front;
+		/* objects are only ever copied into the newest space, so move
+		 * on to the space that was added after this one */
+		{
+			Space *next;
+			for (next = new; next->next != sp; next = next->next)
+				assert(next->next != NULL);
+			sp = next;
+			scan = sp->bot;
+		}
 	}
 }
 
+/* freezeroots -- copy what the freezing pointers reach into the permanent region */
+static void freezeroots(void) {
+	size_t i;
+	Space *savenew = new, *savebase = scanbase;
+	char *savestart = scanstart;
+
+	if (nfreezing == 0)
+		return;
+	if (perm == NULL)
+		perm = newspace(NULL);
+	new = perm;
+	scanbase = new;
+	scanstart = new->current;
+	fmode = TRUE;
+	VERBOSE(("GC freezing %d roots\n", nfreezing));
+	for (i = 0; i < nfreezing; i++)
+		*freezing[i] = forward(*freezing[i]);
+	scanspace();
+	fmode = FALSE;
+	perm = new;
+
+	new = savenew;
+	scanbase = savebase;
+	scanstart = savestart;
+	nfreezing = 0;
+}
+
+
+/* collect -- copy everything reachable from the roots out of old space */
+static void collect(void) {
+	VERBOSE(("GC new space = %ux ... %ux\n", new->bot, new->top));
+	VERBOSE(("GC scanning root list\n"));
+	scanroots(rootlist);
+	VERBOSE(("GC scanning global root list\n"));
+	scanroots(globalrootlist);
+	VERBOSE(("GC scanning exception root list\n"));
+	scanroots(exceptionrootlist);
+#if GCGENERATIONAL
+	VERBOSE(("GC scanning remembered set\n"));
+	scanremembered();
+#endif
+	VERBOSE(("GC scanning permanent references\n"));
+	scanpermrefs();
+#if GCMOSTLYCOPY
+	VERBOSE(("GC scanning pinned spaces\n"));
+	scanpinned();
+#endif
+	VERBOSE(("GC scanning new space\n"));
+	scanspace();
+	VERBOSE(("GC collection done\n\n"));
+}
+
+#if GCGENERATIONAL
+/*
+ * generational collection
+ *	new space is the nursery.  a minor collection copies whatever
+ *	survives in it into tenured space, treating tenured objects as
+ *	roots only if the write barrier (gcremember) noted that they may
+ *	point into the nursery.  a major collection copies everything
+ *	into a fresh tenured space, and happens only when tenured space
+ *	has grown enough since the last one.
+ */
+
+/* minorgc -- promote the survivors of the nursery into tenured space */
+static size_t minorgc(void) {
+	size_t young = spaceused(new), before, cellbytes;
+
+	/* make sure that promotion never overflows the tenured space */
+	if (tenured == NULL || (size_t) SPACEFREE(tenured) < young) {
+		size_t size = spaceused(tenured);
+		if (size < young)
+			size = young;
+		tenured = newspacesz(tenured, size);
+	}
+	before = spaceused(tenured);
+
+	old = new;
+	new = tenured;
+	scanbase = new;
+	scanstart = new->current;
+	markold = FALSE;
+	startcells(FALSE);
+	VERBOSE(("\nGC minor collection starting\n"));
+	collect();
+	tenured = new;
+	sweeplarge();
+	cellbytes = endcells(FALSE);
+
+	deprecate(old);
+	old = NULL;
+	new = newspace(NULL);
+	return spaceused(tenured) - before + cellbytes;
+}
+
+/* majorgc -- copy all live data into a new tenured space */
+static size_t majorgc(void) {
+	Space *sp;
+	size_t size = spaceused(new) + spaceused(tenured);
+
+	forgetremembered();
+	for (sp = new; sp->next != NULL; sp = sp->next)
+		;
+	sp->next = tenured;
+	old = new;
+	new = newspacesz(NULL, size < minspace ? minspace : size);
+	tenured = NULL;
+	scanbase = new;
+	scanstart = new->bot;
+	markold = TRUE;
+	startcells(TRUE);
+	VERBOSE(("\nGC major collection starting\n"));
+	freezeroots();
+	collect();
+	tenured = new;
+
+	deprecate(old);
+	old = NULL;
+	new = newspace(NULL);
+	fullgc = FALSE;
+	sweeplarge();
+	return spaceused(tenured) + endcells(TRUE);
+}
+#endif
+
+
+/*
+ * statistics
+ */
+
+/* gcclock -- the current time in microseconds, for measuring pauses */
+static unsigned long gcclock(void) {
+#if HAVE_GETTIMEOFDAY
+	struct timeval tv;
+	if (gettimeofday(&tv, NULL) == 0)
+		return tv.tv_sec * 1000000UL + tv.tv_usec;
+#endif
+	return 0;
+}
+
+/* endcollection -- account for a collection which began at start and copied some bytes */
+static void endcollection(unsigned long start, size_t copied) {
+	int i;
+	unsigned long pause = gcclock() - start;
+	if (pause > 0 && copied > 0) {
+		unsigned long rate = copied / pause;
+		throughput = (throughput == 0) ? rate : (throughput * 3 + rate) / 4;
+	}
+	for (i = 0; pause != 0 && i < NGCPAUSES - 1; i++)
+		pause >>= 1;
+	++stats.pauses[i];
+	++stats.collections;
+	allocbase = spaceused(new);
+}
+
+/* gcstats -- fill in collector statistics */
+extern void gcstats(GCStats *sp) {
+	*sp = stats;
+	sp->allocated += spaceused(new) - allocbase;
+	sp->minspace = minspace;
+	sp->minpspace = minpspace;
+}
+
+/* gcresetstats -- zero the collector counters */
+extern void gcresetstats(void) {
+	memzero(&stats, sizeof stats);
+	allocbase = spaceused(new);
+}
+
+
+/*
+ * allocation profiling
+ *	while sampling is on, the allocation which crosses every period'th
+ *	byte records the es functions being evaluated and the type of the
+ *	object allocated.  eval() notes where its function name lives with
+ *	gcprofframe(), so the stack can be read back at any allocation.
+ *	samples with the same stack are merged;  $&allocprofile reports
+ *	them as folded stacks, one per line, which flame graph tools read.
+ */
+
+typedef struct Sample Sample;
+struct Sample {
+	char *stack;
+	unsigned long bytes;
+	Sample *next;
+};
+
+#define	NSAMPLEHASH	256
+
+Boolean gcprofiling = FALSE;
+static size_t period;			/* bytes between samples */
+static size_t profleft = (size_t) -1;	/* bytes until the next sample */
+static Sample *samples[NSAMPLEHASH];
+static char ***frames = NULL;		/* frames[d] holds the function name at eval depth d */
+static size_t nframes = 0;
+static char *stackbuf = NULL;		/* where a sample's stack is assembled */
+static size_t stackbuflen = 0;
+
+/* growframes -- make room for frames up to depth */
+static void growframes(unsigned long depth) {
+	size_t n = nframes;
+	if (depth < nframes)
+		return;
+	nframes = (depth + 1) * 2;
+	frames = erealloc(frames, nframes * sizeof (char **));
+	memzero(frames + n, (nframes - n) * sizeof (char **));
+}
+
+/* gcprofframe -- note the variable holding the function name at an eval depth */
+extern void gcprofframe(unsigned long depth, char **name) {
+	growframes(depth);
+	frames[depth] = name;
+}
+
+/* stackcat -- append to the stack being assembled */
+static size_t stackcat(size_t len, const char *s) {
+	size_t n = strlen(s);
+	if (len + n + 2 > stackbuflen) {
+		stackbuflen = (len + n + 2) * 2;
+		stackbuf = erealloc(stackbuf, stackbuflen);
+	}
+	memcpy(stackbuf + len, s, n + 1);
+	return len + n;
+}
+
+/* profsample -- record an allocation which crossed one or more sampling points */
+static void profsample(size_t n, Tag *tag) {
+	unsigned long bytes, d, h = 0;
+	size_t len = 0;
+	char *s;
+	Sample *sp;
+
+	if (!gcprofiling) {
+		profleft = (size_t) -1;
+		return;
+	}
+	n -= profleft;			/* the bytes past the first sampling point */
+	bytes = (1 + n / period) * period;
+	profleft = period - n % period;
+
+	for (d = 1; d <= evaldepth && d < nframes; d++)
+		if (frames[d] != NULL && (s = *frames[d]) != NULL) {
+			len = stackcat(len, s);
+			len = stackcat(len, ";");
+		}
+	len = stackcat(len, tag == NULL ? "?" : tag->typename);
+	for (s = stackbuf; *s != '\0'; s++)
+		h = h * 31 + (unsigned char) *s;
+	h %= NSAMPLEHASH;
+
+	for (sp = samples[h]; sp != NULL; sp = sp->next)
+		if (streq(sp->stack, stackbuf)) {
+			sp->bytes += bytes;
+			return;
+		}
+	sp = ealloc(sizeof (Sample));
+	sp->stack = ealloc(len + 1);
+	memcpy(sp->stack, stackbuf, len + 1);
+	sp->bytes = bytes;
+	sp->next = samples[h];
+	samples[h] = sp;
+}
+
+/* gcprofile -- start sampling every nbytes allocated, discarding old samples; stop if 0 */
+extern void gcprofile(size_t nbytes) {
+	int i;
+	if (nbytes == 0) {
+		gcprofiling = FALSE;
+		profleft = (size_t) -1;
+		return;
+	}
+	for (i = 0; i < NSAMPLEHASH; i++)
+		while (samples[i] != NULL) {
+			Sample *sp = samples[i];
+			samples[i] = sp->next;
+			efree(sp->stack);
+			efree(sp);
+		}
+	/* the functions already running were not noted */
+	growframes(evaldepth);
+	memzero(frames, nframes * sizeof (char **));
+	period = profleft = nbytes;
+	gcprofiling = TRUE;
+}
+
+/* gcprofforall -- call proc for each sampled stack and the bytes allocated there */
+extern void gcprofforall(void (*proc)(void *, char *, unsigned long), void *arg) {
+	int i;
+	Sample *sp;
+	Boolean saveprofiling = gcprofiling;
+	size_t saveleft = profleft;
+	gcprofiling = FALSE;		/* proc may allocate */
+	for (i = 0; i < NSAMPLEHASH; i++)
+		for (sp = samples[i]; sp != NULL; sp = sp->next)
+			(*proc)(arg, sp->stack, sp->bytes);
+	gcprofiling = saveprofiling;
+	profleft = saveleft;
+}
+
+
+/*
+ * the collection policy
+ *	set from the gc-* variables; see gcsetpolicy().  spaces grow in
+ *	proportion to live data, as before, but the nursery is also kept
+ *	small enough that, at the copying throughput measured so far, the
+ *	data which survives it can be copied within the target pause.
+ */
+
+Boolean gcexhausted = FALSE;
+
+/* gcsetpolicy -- change one of the collector's tuning parameters; 0 restores the default */
+extern void gcsetpolicy(GCPolicy which, unsigned long value) {
+	switch (which) {
+	case gcMaxPause:
+		maxpause = value;
+		break;
+	case gcGrowth:
+		growth = (value == 0) ? 2 : value;
+		break;
+	case gcMinSpace:
+		floorspace = (value == 0) ? MIN_minspace : value < 1024 ? 1024 : value;
+		minspace = floorspace;
+		break;
+	case gcMaxHeap:
+		maxheap = value;
+#if GCGENERATIONAL
+		if (maxheap != 0 && majorspace > maxheap)
+			majorspace = maxheap;
+#endif
+		break;
+	default:
+		panic("gcsetpolicy: bad parameter %d", which);
+	}
+}
+
+#if GCGENERATIONAL
+/* pausecap -- limit a nursery so its survivors can be copied within the target pause */
+static size_t pausecap(size_t size, size_t nursery, size_t promoted) {
+	size_t limit;
+	if (maxpause == 0 || throughput == 0 || promoted == 0)
+		return size;
+	limit = (size_t) ((double) maxpause * throughput * nursery / promoted);
+	if (limit < floorspace)
+		limit = floorspace;
+	return size < limit ? size : limit;
+}
+#endif
+
+/* checkheap -- note when live data outgrows gc-max-heap, once per overrun */
+static void checkheap(size_t live) {
+	static Boolean over = FALSE;
+	Boolean was = over;
+	over = maxheap != 0 && live > maxheap;
+	if (over && !was)
+		gcexhausted = TRUE;
+}
+
 
 /*
  * the garbage collector public interface
@@ -366,7 +1790,7 @@ extern void gcenable(void) {
 #if GCALWAYS
 	if (!gcblocked)
 #else
-	if (!gcblocked && new->next != NULL)
+	if (!gcblocked && (new->next != NULL || CELLSFULL()))
 #endif
 		gc();
 }
@@ -399,24 +1823,63 @@ extern Boolean gcisblocked(void) {
 /* gc -- actually do a garbage collection */
 extern void gc(void) {
 	do {
-		size_t livedata;
-		Space *space;
+		size_t livedata, profsave;
+		unsigned long start;
+#if GCGENERATIONAL
+		size_t nursery;
+#endif
+#if GCMOSTLYCOPY
+		Space *sp;
+#endif
 
 #if GCINFO
 		size_t olddata = 0;
 		if (gcinfo)
-			for (space = new; space != NULL; space = space->next)
-				olddata += SPACEUSED(space);
+			olddata = spaceused(new);
 #endif
 
 		assert(gcblocked >= 0);
 		if (gcblocked > 0)
 			return;
 		++gcblocked;
+		profsave = profleft;		/* copying is not allocation */
 
 		assert(new != NULL);
 		assert(old == NULL);
+
+		start = gcclock();
+		stats.allocated += spaceused(new) - allocbase;
+
+#if GCGENERATIONAL
+		nursery = spaceused(new) + younglargesize + nyoungpages * CELLPAGE;
+		if (!fullgc && spaceused(tenured) + oldlargesize + noldpages * CELLPAGE < majorspace) {
+			size_t promoted = minorgc();
+			++stats.minor;
+			stats.copied += promoted;
+#if GCINFO
+			if (gcinfo)
+				eprint(
+					"[minor: new %8d  promoted %8d  old %8d  (pid %5d)]\n",
+					olddata, promoted, spaceused(tenured), getpid()
+				);
+#endif
+			if (minspace < promoted * growth)
+				minspace = promoted * growth * 2;
+			minspace = pausecap(minspace, nursery, promoted);
+			endcollection(start, promoted);
+			profleft = profsave;
+			--gcblocked;
+			continue;
+		}
+		livedata = majorgc();
+#else
 		old = new;
+#if GCMOSTLYCOPY
+		for (sp = old; sp->next != NULL; sp = sp->next)
+			;
+		sp->next = pinned;
+		pinned = NULL;
+#endif
 #if GCPROTECT
 		for (; new->next != NULL; new = new->next)
 			;
@@ -428,25 +1891,35 @@ extern void gc(void) {
 #endif
 		VERBOSE(("\nGC collection starting\n"));
 #if GCVERBOSE
-		for (space = old; space != NULL; space = space->next)
-			VERBOSE(("GC old space = %ux ... %ux\n", space->bot, space->current));
+		{
+			Space *space;
+			for (space = old; space != NULL; space = space->next)
+				VERBOSE(("GC old space = %ux ... %ux\n", space->bot, space->current));
+		}
 #endif
-		VERBOSE(("GC new space = %ux ... %ux\n", new->bot, new->top));
-		VERBOSE(("GC scanning root list\n"));
-		scanroots(rootlist);
-		VERBOSE(("GC scanning global root list\n"));
-		scanroots(globalrootlist);
-		VERBOSE(("GC scanning exception root list\n"));
-		scanroots(exceptionrootlist);
-		VERBOSE(("GC scanning new space\n"));
-		scanspace();
-		VERBOSE(("GC collection done\n\n"));
+		scanbase = new;
+		scanstart = new->bot;
+		startcells(TRUE);
+#if GCMOSTLYCOPY
+		pinstack();
+#endif
+		freezeroots();
+		collect();
 
+#if GCMOSTLYCOPY
+		unpin();
+#endif
 		deprecate(old);
 		old = NULL;
 
-		for (livedata = 0, space = new; space != NULL; space = space->next)
-			livedata += SPACEUSED(space);
+		sweeplarge();
+		livedata = spaceused(new) + endcells(TRUE);
+#if GCMOSTLYCOPY
+		livedata += spaceused(pinned);
+#endif
+#endif
+		++stats.major;
+		stats.copied += livedata;
 
 #if GCINFO
 		if (gcinfo)
@@ -456,18 +1929,48 @@ extern void gc(void) {
 			);
 #endif
 
-		if (minspace < livedata * 2)
-			minspace = livedata * 4;
-		else if (minspace > livedata * 12 && minspace > (MIN_minspace * 2))
+#if GCGENERATIONAL
+		majorspace = (livedata + oldlargesize) * growth;
+		if (majorspace < MIN_majorspace)
+			majorspace = MIN_majorspace;
+		if (maxheap != 0 && majorspace > maxheap)
+			majorspace = maxheap;
+		if (minspace > livedata * growth * 6 && minspace > floorspace * 2)
+			minspace /= 2;
+#else
+		if (minspace < livedata * growth)
+			minspace = livedata * growth * 2;
+		else if (minspace > livedata * growth * 6 && minspace > floorspace * 2)
 			minspace /= 2;
+#endif
+		checkheap(livedata + oldlargesize);
 
+		endcollection(start, livedata);
+		profleft = profsave;
 		--gcblocked;
 	} while (new->next != NULL);
 }
 
+/* gcfull -- provoke a collection of all generations, if enabled */
+extern void gcfull(void) {
+#if GCGENERATIONAL
+	fullgc = TRUE;
+#endif
+	gc();
+}
+
+/* gcfreeze -- move everything reachable from each *ptrs[i] into the permanent region */
+extern void gcfreeze(void **ptrs[], size_t n) {
+	assert(!gcblocked);
+	freezing = ptrs;
+	nfreezing = n;
+	gcfull();
+	nfreezing = 0;
+}
+
 /* pseal -- collect pspace to new with p as its only root, and return the collected p */
 extern void *pseal(void *p) {
-	size_t psize = 0;
+	size_t psize = 0, profsave;
 	Space *sp;
 #if GCINFO
 	size_t newdata = 0, livedata = 0;
@@ -494,6 +1997,7 @@ extern void *pseal(void *p) {
 
 	assert (gcblocked >= 0);
 	++gcblocked;
+	profsave = profleft;
 
 #if GCVERBOSE
 	for (sp = pspace; sp != NULL; sp = sp->next)
@@ -504,7 +2008,7 @@ extern void *pseal(void *p) {
 
 		pmode = TRUE;
 		p = forward(p);
-		(*(TAG(p))->scan)(p);
+		(*tagof(p)->scan)(p);
 		pmode = FALSE;
 	}
 
@@ -535,6 +2039,7 @@ extern void *pseal(void *p) {
 	pspace = newpspace(NULL);
 #endif
 
+	profleft = profsave;
 	--gcblocked;
 	return p;
 }
@@ -548,10 +2053,16 @@ extern void initgc(void) {
 	new = mkspace(&spaces[FIRSTSPACE], NULL, minspace);
 	pspace = mkspace(&spaces[0], NULL, minpspace);
 #else
+#if MAPSPACES
+	initmmu();
+#endif
 	new = newspace(NULL);
 	pspace = newpspace(NULL);
 #endif
 	old = NULL;
+#if GCGENERATIONAL
+	tenured = NULL;
+#endif
 }
 
 
@@ -562,15 +2073,30 @@ extern void initgc(void) {
 /* gcalloc -- allocate an object in new space */
 extern void *gcalloc(size_t nbytes, Tag *tag) {
 	size_t n = ALIGN(nbytes + sizeof (Tag *));
+	if (n > profleft)
+		profsample(n, tag);
+	else
+		profleft -= n;
 #if GCALWAYS
 	gc();
 #endif
 	assert(tag == NULL || tag->magic == TAGMAGIC);
+	if (!fmode) {
+#if GCBIBOP
+		if (tag != NULL && tag->cell != cellNone)
+			return cellalloc(nbytes, tag);
+#endif
+		if (nbytes >= LARGEOBJECT)
+			return largealloc(nbytes, tag);
+	}
 	for (;;) {
 		Tag **p = (void *) new->current;
 		char *q = ((char *) p) + n;
 		if (q <= new->top) {
 			new->current = q;
+#if GCMOSTLYCOPY
+			SETSTART(new, p);
+#endif
 			*p++ = tag;
 			return p;
 		}
@@ -586,6 +2112,10 @@ extern void *gcalloc(size_t nbytes, Tag *tag) {
 /* palloc -- allocate an object in pspace */
 extern void *palloc(size_t nbytes, Tag *tag) {
 	size_t n = ALIGN(nbytes + sizeof (Tag *));
+	if (n > profleft)
+		profsample(n, tag);
+	else
+		profleft -= n;
 	assert(tag == NULL || tag->magic == TAGMAGIC);
 	for (;;) {
 		Tag **p = (void *) pspace->current;
@@ -733,7 +2263,6 @@ static char *tree1name(NodeKind k) {
 	case nQword:	return "Qword";
 	case nCall:	return "Call";
 	case nThunk:	return "Thunk";
-	case nVar:	return "Var";
 	case nWord:	return "Word";
 	}
 }
@@ -751,6 +2280,7 @@ static char *tree2name(NodeKind k) {
 	case nLocal:	return "Local";
 	case nMatch:	return "Match";
 	case nExtract:	return "Extract";
+	case nVar:	return "Var";
 	case nVarsub:	return "Varsub";
 	}
 }
@@ -852,16 +2382,25 @@ static size_t dump(Tag *t, void *p) {
 	return 0;
 }
 
-extern void memdump(void) {
-	Space *sp;
-	for (sp = new; sp != NULL; sp = sp->next) {
+static void memdump0(Space *sp) {
+	for (; sp != NULL; sp = sp->next) {
 		char *scan = sp->bot;
 		while (scan < sp->current) {
 			Tag *tag = *(Tag **) scan;
+#if GCGENERATIONAL
+			tag = FORGET(tag);
+#endif
 			assert(tag->magic == TAGMAGIC);
 			scan += sizeof (Tag *);
 			scan += ALIGN(dump(tag, scan));
 		}
 	}
 }
+
+extern void memdump(void) {
+	memdump0(new);
+#if GCGENERATIONAL
+	memdump0(tenured);
+#endif
+}
 #endif
@@ -9,25 +9,37 @@
 struct Tag {
 	void *(*copy)(void *);
 	size_t (*scan)(void *);
+	int cell;			/* with GCBIBOP, which pages hold the objects */
+	char *typename;			/* for $&heapcensus and debugging output */
 #if ASSERTIONS || GCVERBOSE
 	long magic;
-	char *typename;
 #endif
 };
 
 extern Tag StringTag;
 
+/* small, fixed-size types which may be allocated in pages of their own */
+enum { cellNone, cellList, cellTerm, cellBinding, cellClosure, cellStrList, NCELLTYPES };
+
 #if ASSERTIONS || GCVERBOSE
 enum {TAGMAGIC = 0xDefaced};
 #define	DefineTag(t, storage) \
 	static void *CONCAT(t,Copy)(void *); \
 	static size_t CONCAT(t,Scan)(void *); \
-	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan), TAGMAGIC, STRING(t) }
+	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan), cellNone, STRING(t), TAGMAGIC }
+#define	DefineCellTag(t, storage) \
+	static void *CONCAT(t,Copy)(void *); \
+	static size_t CONCAT(t,Scan)(void *); \
+	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan), CONCAT(cell,t), STRING(t), TAGMAGIC }
 #else
 #define	DefineTag(t, storage) \
 	static void *CONCAT(t,Copy)(void *); \
 	static size_t CONCAT(t,Scan)(void *); \
-	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan) }
+	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan), cellNone, STRING(t) }
+#define	DefineCellTag(t, storage) \
+	static void *CONCAT(t,Copy)(void *); \
+	static size_t CONCAT(t,Scan)(void *); \
+	storage Tag CONCAT(t,Tag) = { CONCAT(t,Copy), CONCAT(t,Scan), CONCAT(cell,t), STRING(t) }
 #endif
 
 /*
@@ -53,5 +65,6 @@ extern char *sealcountedbuffer(Buffer *buf);
 extern char *psealbuffer(Buffer *buf);		/* pspace variant of sealbuffer */
 extern char *psealcountedbuffer(Buffer *buf);	/* pspace variant of sealcountedbuffer */
 extern void freebuffer(Buffer *buf);
+extern Buffer *capture(Buffer *buf);		/* in print.c */
 
 extern void *forward(void *p);
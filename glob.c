@@ -174,22 +174,29 @@ static List *glob1(const char *pattern, const char *quote) {
 
 /* glob0 -- glob a list, (destructively) passing through entries we don't care about */
 static List *glob0(List *list, StrList *quote) {
-	List *result, **prevp, *expand1;
+	List *result, *tail, *link, *expand1;
 	
-	for (result = NULL, prevp = &result; list != NULL; list = list->next, quote = quote->next) {
+	for (result = tail = NULL; list != NULL; list = list->next, quote = quote->next) {
 		char *str;
 		if (
 			quote->str == QUOTED
 			|| !haswild(str = getstr(list->term), quote->str)
 			|| (expand1 = glob1(str, quote->str)) == NULL
-		) {
-			*prevp = list;
-			prevp = &list->next;
-		} else {
-			*prevp = sortlist(expand1);
-			while (*prevp != NULL)
-				prevp = &(*prevp)->next;
+		)
+			link = list;
+		else
+			link = sortlist(expand1);
+		if (result == NULL)
+			result = link;
+		else {
+			tail->next = link;
+			gcremember(tail, link);
 		}
+		if (link == list)
+			tail = link;
+		else
+			for (tail = link; tail->next != NULL; tail = tail->next)
+				;
 	}
 	return result;
 }
@@ -251,6 +258,7 @@ static char *expandhome(char *s, StrList *qp, Binding *binding) {
 				q[len] = '\0';
 			}
 			quote->str = q;
+			gcremember(quote, q);
 		}
 		RefEnd(home);
 	}
@@ -279,6 +287,7 @@ extern List *glob(List *list, StrList *quote, Binding *binding) {
 				str = expandhome(str, qp, binding);
 				tmp = mkstr(str);
 				lr->term = tmp;
+				gcremember(lr, tmp);
 				lp = lr;
 				qp = qr;
 				list = l0;
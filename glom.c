@@ -148,6 +148,21 @@ static List *subscript(List *list, List *subs) {
 	RefReturn(r);
 }
 
+/*
+ * lexical -- follow a variable reference resolved at parse time to its
+ *	binding, if the binding at that distance still has the right name;
+ *	otherwise the caller falls back to searching by name
+ */
+static Binding *lexical(Tree *var, Binding *bp) {
+	int i;
+	char *name = var->u[0].p->u[0].s;
+	for (i = var->u[1].i; --i > 0 && bp != NULL;)
+		bp = bp->next;
+	if (bp != NULL && (bp->name == name || streq(bp->name, name)))
+		return bp;
+	return NULL;
+}
+
 /* glom1 -- glom when we don't need to produce a quote list */
 static List *glom1(Tree *tree, Binding *binding) {
 	Ref(List *, result, NULL);
@@ -179,6 +194,14 @@ static List *glom1(Tree *tree, Binding *binding) {
 			tp = NULL;
 			break;
 		case nVar:
+			if (tp->u[1].i != 0) {
+				Binding *b = lexical(tp, bp);
+				if (b != NULL) {
+					list = listcopy(b->defn);
+					tp = NULL;
+					break;
+				}
+			}
 			Ref(List *, var, glom1(tp->u[0].p, bp));
 			tp = NULL;
 			for (; var != NULL; var = var->next) {
@@ -186,8 +209,10 @@ static List *glom1(Tree *tree, Binding *binding) {
 				if (list != NULL) {
 					if (result == NULL)
 						tail = result = list;
-					else
+					else {
 						tail->next = list;
+						gcremember(tail, list);
+					}
 					for (; tail->next != NULL; tail = tail->next)
 						;
 				}
@@ -230,8 +255,10 @@ static List *glom1(Tree *tree, Binding *binding) {
 		if (list != NULL) {
 			if (result == NULL)
 				tail = result = list;
-			else
+			else {
 				tail->next = list;
+				gcremember(tail, list);
+			}
 			for (; tail->next != NULL; tail = tail->next)
 				;
 		}
@@ -303,6 +330,8 @@ extern List *glom2(Tree *tree, Binding *binding, StrList **quotep) {
 				assert(*quotep != NULL);
 				tail->next = list;
 				qtail->next = qlist;
+				gcremember(tail, list);
+				gcremember(qtail, qlist);
 			}
 			for (; tail->next != NULL; tail = tail->next, qtail = qtail->next)
 				;
@@ -315,9 +344,33 @@ extern List *glom2(Tree *tree, Binding *binding, StrList **quotep) {
 	RefReturn(result);
 }
 
+/*
+ * globbable -- could globbing change what a tree gloms to?  only
+ *	unquoted words, alone or in lists and concatenations, reach glob()
+ *	unquoted, so a tree with no wildcard or tilde in them needs no
+ *	quoting list at all.
+ */
+static Boolean globbable(Tree *tp) {
+	while (tp != NULL)
+		switch (tp->kind) {
+		case nWord:
+			return strpbrk(tp->u[0].s, "*?[~") != NULL;
+		case nList:
+			if (globbable(tp->u[0].p))
+				return TRUE;
+			tp = tp->u[1].p;
+			break;
+		case nConcat:
+			return globbable(tp->u[0].p) || globbable(tp->u[1].p);
+		default:
+			return FALSE;
+		}
+	return FALSE;
+}
+
 /* glom -- top level glom dispatching */
 extern List *glom(Tree *tree, Binding *binding, Boolean globit) {
-	if (globit) {
+	if (globit && globbable(tree)) {
 		Ref(List *, list, NULL);
 		Ref(StrList *, quote, NULL);
 		RefAdd(binding);
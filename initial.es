@@ -65,6 +65,8 @@
 
 fn-.		= $&dot
 fn-access	= $&access
+fn-arith	= $&arith
+fn-arithtest	= $&arithtest
 fn-break	= $&break
 fn-catch	= $&catch
 fn-echo		= $&echo
@@ -94,11 +96,15 @@ fn-false	= { result 1 }
 
 #	These functions just generate exceptions for control-flow
 #	constructions.  The for command and the while builtin both
-#	catch the break exception, and lambda-invocation catches
-#	return.  The interpreter main() routine (and nothing else)
-#	catches the exit exception.
+#	catch the break and continue exceptions, and lambda-invocation
+#	catches return.  The interpreter main() routine (and nothing
+#	else) catches the exit exception.  (The shell passes return,
+#	break and continue directly to the frame which catches them
+#	when it can, rather than unwinding to a handler, but the
+#	effect is the same.)
 
 fn-break	= throw break
+fn-continue	= throw continue
 fn-exit		= throw exit
 fn-return	= throw return
 
@@ -175,11 +181,14 @@ fn whatis {
 
 #	The while function is implemented with the forever looping primitive.
 #	While uses $&noreturn to indicate that, while it is a lambda, it
-#	does not catch the return exception.  It does, however, catch break.
+#	does not catch the return exception.  It does, however, catch break,
+#	and continue, which retries the loop.
 
 fn-while = $&noreturn @ cond body {
 	catch @ e value {
-		if {!~ $e break} {
+		if {~ $e continue} {
+			throw retry
+		} {!~ $e break} {
 			throw $e $value
 		}
 		result $value
@@ -340,9 +349,10 @@ fn %backquote {
 #	braces.  The logical operators are implemented in terms of if.
 #
 #	%and and %or are recursive, which is slightly inefficient given
-#	the current implementation of es -- it is not properly tail recursive
-#	-- but that can be fixed and it's still better to write more of
-#	the shell in es itself.
+#	the current implementation of es -- calls in tail position reuse
+#	their frame, but the bodies of $&noreturn lambdas are not run in
+#	tail position -- but it's still better to write more of the shell
+#	in es itself.
 
 fn-%seq		= $&seq
 
@@ -453,6 +463,25 @@ fn-%close	= $&close
 fn-%dup		= $&dup
 fn-%pipe	= $&pipe
 
+#	%parallel runs a command once for each of its arguments, in child
+#	processes, at most limit of them at a time.  Output appears in the
+#	order of the arguments and the result is the list of exit statuses.
+#	Where the builtin is missing, the commands are run one at a time.
+#
+#		%parallel limit cmd args ...
+
+if {~ <=$&primitives parallel} {
+	fn-%parallel = $&parallel
+} {
+	fn-%parallel = @ limit cmd args {
+		let (result = ()) {
+			for (arg = $args)
+				result = $result <={$&pipe {$cmd $arg}}
+			result $result
+		}
+	}
+}
+
 #	Input/Output substitution (i.e., the >{} and <{} forms) provide an
 #	interesting case.  If es is compiled for use with /dev/fd, these
 #	functions will be built in.  Otherwise, versions of the hooks are
@@ -568,11 +597,13 @@ if {~ <=$&primitives writeto} {
 
 fn-%home	= $&home
 
-#	Path searching used to be a primitive, but the access function
-#	means that it can be written easier in es.  Is is not called for
-#	absolute path names or for functions.
+#	Path searching is equivalent to
+#		fn %pathsearch name { access -n $name -1e -xf $path }
+#	but the primitive remembers what is in each directory of $path,
+#	and is called directly by the shell while it is the definition.
+#	It is not called for absolute path names or for functions.
 
-fn %pathsearch name { access -n $name -1e -xf $path }
+fn-%pathsearch	= $&pathsearch
 
 #	The exec-failure hook is called in the child if an exec() fails.
 #	A default version is provided (under conditional compilation) for
@@ -732,6 +763,15 @@ set-signals		= $&setsignals
 set-noexport		= $&setnoexport
 set-max-eval-depth	= $&setmaxevaldepth
 
+#	The gc-* variables tune the garbage collector.  Each settor passes
+#	the new value to $&setgcpolicy, which checks it; unsetting one of
+#	these variables restores the collector's default.
+
+set-gc-max-pause	= @ { $&setgcpolicy max-pause $* }
+set-gc-growth		= @ { $&setgcpolicy growth $* }
+set-gc-min-space	= @ { $&setgcpolicy min-space $* }
+set-gc-max-heap		= @ { $&setgcpolicy max-heap $* }
+
 #	If the primitives $&sethistory or $&resetterminal are defined (meaning
 #	that readline or editline is being used), setting the variables $TERM,
 #	$TERMCAP, or $history should notify the line editor library.
@@ -251,6 +251,8 @@ extern Tree *parse(char *pr1, char *pr2) {
 		RefEnd(e);
 	}
 
+	resolve(parsetree);
+
 #if LISPTREES
 	Ref(Tree *, pt, pseal(parsetree));
 	if (input->runflags & run_lisptrees)
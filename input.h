@@ -47,6 +47,11 @@ extern Tree *parsetree;
 extern int yyparse(void);
 
 
+/* syntax.c */
+
+extern Tree *resolve(Tree *t);
+
+
 /* heredoc.c */
 
 extern void emptyherequeue(void);
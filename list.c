@@ -7,7 +7,7 @@
  * allocation and garbage collector support
  */
 
-DefineTag(List, static);
+DefineCellTag(List, static);
 
 extern List *mklist(Term *term, List *next) {
 	gcdisable();
@@ -46,6 +46,7 @@ extern List *reverse(List *list) {
 	do {
 		next = list->next;
 		list->next = prev;
+		gcremember(list, prev);
 		prev = list;
 	} while ((list = next) != NULL);
 	return prev;
@@ -63,7 +63,7 @@ cmdsan	: cmdsa			{ $$ = $1; }
 cmd	:		%prec LET		{ $$ = NULL; }
 	| simple				{ $$ = redirect($1); if ($$ == &errornode) YYABORT; }
 	| redir cmd	%prec '!'		{ $$ = redirect(mk(nRedir, $1, $2)); if ($$ == &errornode) YYABORT; }
-	| first assign				{ $$ = mk(nAssign, $1, $2); }
+	| first assign				{ $$ = mk(nAssign, mkname($1), $2); }
 	| fn					{ $$ = $1; }
 	| binder nl '(' bindings ')' nl cmd	{ $$ = mk($1, $4, $7); }
 	| cmd ANDAND nl cmd			{ $$ = mkseq("%and", $1, $4); }
@@ -81,8 +81,8 @@ cases	: case				{ $$ = treecons($1, NULL); }
 case	:				{ $$ = NULL; }
 	| word first			{ $$ = mk(nMatch, $1, thunkify($2)); }
 
-simple	: first				{ $$ = treecons($1, NULL); }
-	| first args			{ $$ = firstprepend($1, $2); }
+simple	: first				{ $$ = treecons(mkname($1), NULL); }
+	| first args			{ $$ = firstprepend(mkname($1), $2); }
 
 args	: word				{ $$ = treecons($1, NULL); }
 	| redir				{ $$ = redirappend(NULL, $1); }
@@ -98,7 +98,7 @@ bindings: binding			{ $$ = treecons($1, NULL); }
 
 binding	:				{ $$ = NULL; }
 	| fn				{ $$ = $1; }
-	| first assign			{ $$ = mk(nAssign, $1, $2); }
+	| first assign			{ $$ = mk(nAssign, mkname($1), $2); }
 
 assign	: caret '=' caret words		{ $$ = $4; }
 
@@ -118,11 +118,11 @@ comword	: param				{ $$ = $1; }
 	| '(' nlwords ')'		{ $$ = $2; }
 	| '{' body '}'			{ $$ = thunkify($2); }
 	| '@' params '{' body '}'	{ $$ = mklambda($2, $4); }
-	| '$' sword			{ $$ = mk(nVar, $2); }
-	| '$' sword SUB words ')'	{ $$ = mk(nVarsub, $2, $4); }
+	| '$' sword			{ $$ = mk(nVar, mkname($2)); }
+	| '$' sword SUB words ')'	{ $$ = mk(nVarsub, mkname($2), $4); }
 	| CALL sword			{ $$ = mk(nCall, $2); }
-	| COUNT sword			{ $$ = mk(nCall, prefix("%count", treecons(mk(nVar, $2), NULL))); }
-	| FLAT sword			{ $$ = flatten(mk(nVar, $2), " "); }
+	| COUNT sword			{ $$ = mk(nCall, prefix("%count", treecons(mk(nVar, mkname($2)), NULL))); }
+	| FLAT sword			{ $$ = flatten(mk(nVar, mkname($2)), " "); }
 	| PRIM WORD			{ $$ = mk(nPrim, $2); }
 	| '`' sword			{ $$ = backquote(mk(nVar, mk(nWord, "ifs")), $2); }
 	| BFLAT sword			{ $$ = flatten(backquote(mk(nVar, mk(nWord, "ifs")), $2), " "); }
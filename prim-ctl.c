@@ -7,7 +7,13 @@ PRIM(seq) {
 	Ref(List *, result, ltrue);
 	Ref(List *, lp, list);
 	for (; lp != NULL; lp = lp->next)
-		result = eval1(lp->term, evalflags &~ (lp->next == NULL ? 0 : eval_inchild));
+		if (lp->next == NULL)
+			result = tailcall(mklist(lp->term, NULL), evalflags);
+		else {
+			result = eval1(lp->term, evalflags &~ eval_inchild);
+			if (escaping(result))
+				break;
+		}
 	RefEnd(lp);
 	RefReturn(result);
 }
@@ -17,11 +23,15 @@ PRIM(if) {
 	for (; lp != NULL; lp = lp->next) {
 		List *cond = ltrue;
 		if (lp->next != NULL) {
-			cond = eval1(lp->term, 0);
+			cond = eval1(lp->term, evalflags & eval_escape);
+			if (escaping(cond)) {
+				RefPop(lp);
+				return cond;
+			}
 			lp = lp->next;
 		}
 		if (istrue(cond)) {
-			List *result = eval1(lp->term, evalflags);
+			List *result = tailcall(mklist(lp->term, NULL), evalflags);
 			RefPop(lp);
 			return result;
 		}
@@ -41,8 +51,7 @@ PRIM(forever) {
 PRIM(throw) {
 	if (list == NULL)
 		fail("$&throw", "usage: throw exception [args ...]");
-	throw(list);
-	NOTREACHED;
+	return escape(list, evalflags);
 }
 
 PRIM(catch) {
@@ -94,9 +103,9 @@ PRIM(catch) {
 }
 
 extern Dict *initprims_controlflow(Dict *primdict) {
-	X(seq);
-	X(if);
-	X(throw);
+	XE(seq);
+	XE(if);
+	XE(throw);
 	X(forever);
 	X(catch);
 	return primdict;
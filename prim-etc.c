@@ -241,7 +241,147 @@ PRIM(batchloop) {
 }
 
 PRIM(collect) {
-	gc();
+	gcfull();
+	return ltrue;
+}
+
+PRIM(freeze) {
+	freezevars(list);
+	return ltrue;
+}
+
+static List *statpair(char *name, unsigned long value, List *rest) {
+	return mklist(mkstr(name), mklist(mkstr(str("%lud", value)), rest));
+}
+
+PRIM(gcstats) {
+	int i;
+	GCStats stats;
+	List *lp = NULL;
+
+	if (list != NULL && (list->next != NULL || !termeq(list->term, "reset")))
+		fail("$&gcstats", "usage: $&gcstats [reset]");
+	gcstats(&stats);
+	if (list != NULL)
+		gcresetstats();
+
+	gcdisable();
+	for (i = NGCPAUSES; i-- > 0;)
+		if (stats.pauses[i] != 0)
+			lp = statpair(str("pause-%ludus", 1UL << i), stats.pauses[i], lp);
+	lp = statpair("minpspace", stats.minpspace, lp);
+	lp = statpair("minspace", stats.minspace, lp);
+	lp = statpair("allocated", stats.allocated, lp);
+	lp = statpair("copied", stats.copied, lp);
+	lp = statpair("major", stats.major, lp);
+	lp = statpair("minor", stats.minor, lp);
+	lp = statpair("collections", stats.collections, lp);
+	Ref(List *, result, lp);
+	gcenable();
+	RefReturn(result);
+}
+
+PRIM(dictstats) {
+	DictStats stats;
+	unsigned long mean;
+
+	if (list != NULL)
+		fail("$&dictstats", "usage: $&dictstats");
+	varstats(&stats);
+	mean = stats.count == 0 ? 0 : (stats.totalprobe * 100 + stats.count / 2) / stats.count;
+
+	gcdisable();
+	Ref(List *, result, NULL);
+	result = statpair("symbols", stats.symbols, NULL);
+	result = mklist(mkstr("meanprobe"), mklist(mkstr(str("%lud.%02lud", mean / 100, mean % 100)), result));
+	result = statpair("maxprobe", stats.maxprobe, result);
+	result = statpair("load", stats.size == 0 ? 0 : (stats.count * 100UL) / stats.size, result);
+	result = statpair("entries", stats.count, result);
+	result = statpair("size", stats.size, result);
+	gcenable();
+	RefReturn(result);
+}
+
+#define	NCENSUS	32
+
+PRIM(heapcensus) {
+	int i, j, n;
+	long ntop = 0;
+	Boolean byvar = FALSE;
+	GCCensus types[NCENSUS], t;
+	GCLargest *top = NULL;
+	List *lp = NULL;
+
+	if (list != NULL) {
+		char *s;
+		if (list->next == NULL || list->next->next != NULL)
+			fail("$&heapcensus", "usage: $&heapcensus [largest n | vars n]");
+		if (termeq(list->term, "vars"))
+			byvar = TRUE;
+		else if (!termeq(list->term, "largest"))
+			fail("$&heapcensus", "usage: $&heapcensus [largest n | vars n]");
+		ntop = strtol(getstr(list->next->term), &s, 0);
+		if (ntop <= 0 || *s != '\0')
+			fail("$&heapcensus", "$&heapcensus must be given a positive count");
+		top = ealloc(ntop * sizeof (GCLargest));
+	}
+
+	gcdisable();
+	if (byvar)
+		n = censusvars(types, NCENSUS, NULL, 0, top, ntop);
+	else
+		n = censusvars(types, NCENSUS, top, ntop, NULL, 0);
+	if (top != NULL) {
+		for (i = ntop; i-- > 0;) {
+			if (top[i].bytes == 0)
+				continue;
+			if (byvar)
+				lp = mklist(mkstr(top[i].var), lp);
+			else
+				lp = mklist(mkstr(top[i].type),
+					    mklist(mkstr(top[i].var == NULL ? "" : top[i].var), lp));
+			lp = mklist(mkstr(str("%lud", top[i].bytes)), lp);
+		}
+		efree(top);
+	} else {
+		for (i = 1; i < n; i++)		/* biggest first */
+			for (j = i; j > 0 && types[j].bytes > types[j - 1].bytes; j--) {
+				t = types[j];
+				types[j] = types[j - 1];
+				types[j - 1] = t;
+			}
+		for (i = n; i-- > 0;)
+			lp = mklist(mkstr(types[i].type),
+				    mklist(mkstr(str("%lud", types[i].count)),
+					   mklist(mkstr(str("%lud", types[i].bytes)), lp)));
+	}
+	Ref(List *, result, lp);
+	gcenable();
+	RefReturn(result);
+}
+
+static void addsample(void *arg, char *stack, unsigned long bytes) {
+	List **lp = arg;
+	Term *t = mkstr(str("%s %lud", stack, bytes));
+	*lp = mklist(t, *lp);
+}
+
+PRIM(allocprofile) {
+	char *s;
+	long period;
+
+	if (list == NULL) {
+		Ref(List *, lp, NULL);
+		gcprofforall(addsample, &lp);
+		lp = sortlist(lp);
+		RefReturn(lp);
+	}
+	if (list->next != NULL)
+		fail("$&allocprofile", "usage: $&allocprofile [period]");
+	period = strtol(getstr(list->term), &s, 0);
+	if (period < 0 || *s != '\0')
+		fail("$&allocprofile", "$&allocprofile: period must be a number of bytes");
+	gcprofile(period);
 	return ltrue;
 }
 
@@ -303,6 +443,35 @@ PRIM(setmaxevaldepth) {
 	RefReturn(lp);
 }
 
+PRIM(setgcpolicy) {
+	static const struct { char *name; GCPolicy which; } policies[] = {
+		{ "max-pause",	gcMaxPause },
+		{ "growth",	gcGrowth },
+		{ "min-space",	gcMinSpace },
+		{ "max-heap",	gcMaxHeap },
+	};
+	char *name, *s;
+	unsigned long n = 0;
+	int i;
+	if (list == NULL || (list->next != NULL && list->next->next != NULL))
+		fail("$&setgcpolicy", "usage: $&setgcpolicy parameter [value]");
+	name = getstr(list->term);
+	for (i = 0; i < arraysize(policies); i++)
+		if (streq(name, policies[i].name))
+			break;
+	if (i == arraysize(policies))
+		fail("$&setgcpolicy", "unknown collector parameter: %s", name);
+	Ref(List *, lp, list->next);
+	if (lp != NULL) {
+		s = getstr(lp->term);
+		n = strtoul(s, &s, 0);
+		if (*getstr(lp->term) == '-' || *s != '\0')
+			fail("$&setgcpolicy", "gc-%s must be set to a non-negative integer", name);
+	}
+	gcsetpolicy(policies[i].which, n);
+	RefReturn(lp);
+}
+
 #if HAVE_READLINE
 PRIM(sethistory) {
 	if (list == NULL) {
@@ -350,28 +519,34 @@ PRIM(resetterminal) {
  */
 
 extern Dict *initprims_etc(Dict *primdict) {
-	X(echo);
-	X(count);
+	XE(echo);
+	XE(count);
 	X(version);
 	X(exec);
 	X(dot);
-	X(flatten);
+	XE(flatten);
 	X(whatis);
-	X(split);
-	X(fsplit);
+	XE(split);
+	XE(fsplit);
 	X(var);
 	X(parse);
 	X(batchloop);
 	X(collect);
+	X(gcstats);
+	X(heapcensus);
+	X(dictstats);
+	X(allocprofile);
+	X(freeze);
 	X(home);
 	X(setnoexport);
 	X(vars);
 	X(internals);
-	X(result);
+	XE(result);
 	X(isinteractive);
 	X(exitonfalse);
-	X(noreturn);
+	XE(noreturn);
 	X(setmaxevaldepth);
+	X(setgcpolicy);
 #if HAVE_READLINE
 	X(sethistory);
 	X(writehistory);
@@ -1,11 +1,15 @@
 /* prim-io.c -- input/output and redirection primitives ($Revision: 1.2 $) */
 
+#define	REQUIRE_POLL	1
+
 #include "es.h"
 #include "gc.h"
 #include "prim.h"
 
 #include <limits.h>
 
+#define	BUFSIZE	4096
+
 static const char *caller;
 
 static int getnumber(const char *s) {
@@ -96,6 +100,8 @@ PRIM(openfile) {
 	lp = list->next;
 	list->next = lp->next;
 	lp->next = list;
+	gcremember(list, list->next);
+	gcremember(lp, list);
 	return redir(redir_openfile, lp, evalflags);
 }
 
@@ -214,6 +220,158 @@ PRIM(here) {
 	RefReturn(lp);
 }
 
+#if HAVE_POLL && HAVE_POLL_H
+/*
+ * parallel
+ *	runs cmd once for each argument, with at most limit copies running
+ *	at a time.  the output of each copy is passed on in the order of
+ *	the arguments:  that of the earliest unfinished copy is written
+ *	as it arrives, and that of later ones is held until their turn.
+ *	the result is the list of exit statuses, in the same order.
+ */
+
+typedef struct {
+	int pid, fd, status;
+	Boolean done;
+	Buffer *held;
+} Worker;
+
+/* release -- write out and discard the output held for a worker */
+static void release(Worker *w) {
+	Buffer *held = w->held;
+	if (held == NULL)
+		return;
+	w->held = NULL;
+	ewrite(fdmap(1), held->str, held->current);
+	freebuffer(held);
+}
+
+/* fanout -- start the workers, limit at a time, and pass on their output */
+static void fanout(List *list, Worker *workers, int n, struct pollfd *fds, int *ready, int evalflags) {
+	int i, nfds, limit, started = 0, running = 0, head = 0;
+	char buf[BUFSIZE];
+
+	Ref(Term *, cmd, list->next->term);
+	Ref(List *, args, list->next->next);
+	limit = getnumber(getstr(list->term));
+	if (limit < 1)
+		fail(caller, "parallel: limit must be at least 1");
+	while (head < n) {
+		for (; running < limit && started < n; args = args->next) {
+			int p[2];
+			Worker *w = &workers[started];
+			if ((w->pid = pipefork(p, NULL)) == 0) {
+				close(p[0]);
+				mvfd(p[1], 1);
+				esexit(exitstatus(eval(mklist(cmd, mklist(args->term, NULL)),
+						       NULL, evalflags | eval_inchild)));
+			}
+			close(p[1]);
+			w->fd = p[0];
+			registerfd(&w->fd, TRUE);
+			++started;
+			++running;
+		}
+
+		for (nfds = 0, i = head; i < started; i++)
+			if (workers[i].fd != -1) {
+				fds[nfds].fd = workers[i].fd;
+				fds[nfds].events = POLLIN;
+				fds[nfds].revents = 0;
+				ready[nfds++] = i;
+			}
+		if (poll(fds, nfds, -1) == -1) {
+			if (errno != EINTR)
+				fail(caller, "poll: %s", esstrerror(errno));
+			SIGCHK();
+			continue;
+		}
+
+		for (i = 0; i < nfds; i++) {
+			long len;
+			Worker *w = &workers[ready[i]];
+			if (fds[i].revents == 0)
+				continue;
+			if ((len = read(w->fd, buf, sizeof buf)) > 0) {
+				if (ready[i] == head)
+					ewrite(fdmap(1), buf, len);
+				else
+					w->held = bufncat(w->held == NULL ? openbuffer(0) : w->held, buf, len);
+				continue;
+			}
+			if (len == -1) {
+				if (errno == EINTR)
+					continue;
+				fail(caller, "read: %s", esstrerror(errno));
+			}
+			unregisterfd(&w->fd);
+			close(w->fd);
+			w->fd = -1;
+			w->status = ewaitfor(w->pid);
+			w->done = TRUE;
+			--running;
+		}
+
+		while (head < n && workers[head].done)
+			if (++head < n)
+				release(&workers[head]);
+	}
+	RefEnd2(args, cmd);
+}
+
+PRIM(parallel) {
+	int n, i, *ready;
+	Worker *workers;
+	struct pollfd *fds;
+
+	caller = "$&parallel";
+	if (length(list) < 2)
+		fail(caller, "usage: parallel limit cmd [args ...]");
+	n = length(list->next->next);
+
+	workers = ealloc((n + 1) * sizeof (Worker));
+	fds = ealloc((n + 1) * sizeof (struct pollfd));
+	ready = ealloc((n + 1) * sizeof (int));
+	for (i = 0; i < n; i++) {
+		workers[i].pid = workers[i].fd = -1;
+		workers[i].status = 0;
+		workers[i].done = FALSE;
+		workers[i].held = NULL;
+	}
+
+	ExceptionHandler
+		fanout(list, workers, n, fds, ready, evalflags);
+	CatchException (e)
+		for (i = 0; i < n; i++) {
+			Worker *w = &workers[i];
+			if (w->fd != -1) {
+				unregisterfd(&w->fd);
+				close(w->fd);
+			}
+			if (w->pid > 0 && !w->done)
+				ewaitfor(w->pid);
+			if (w->held != NULL)
+				freebuffer(w->held);
+		}
+		efree(workers);
+		efree(fds);
+		efree(ready);
+		throw(e);
+	EndExceptionHandler
+
+	efree(fds);
+	efree(ready);
+	Ref(List *, result, NULL);
+	while (n > 0) {
+		int status = workers[--n].status;
+		printstatus(0, status);
+		result = mklist(mkstr(mkstatus(status)), result);
+	}
+	efree(workers);
+	RefReturn(result);
+}
+#endif
+
 PRIM(pipe) {
 	int n, infd, inpipe;
 	static int *pids = NULL, pidmax = 0;
@@ -356,8 +514,6 @@ PRIM(writeto) {
 }
 #endif
 
-#define	BUFSIZE	4096
-
 static List *bqinput(const char *sep, int fd) {
 	long n;
 	char in[BUFSIZE];
@@ -376,6 +532,247 @@ restart:
 	return endsplit();
 }
 
+/*
+ * pure commands
+ *	a backquote has to run its body in a child so that nothing the
+ *	body does can affect the shell.  but a body which only prints,
+ *	through primitives known to have no other effect, and functions
+ *	made of the same, can run in the shell itself with its output
+ *	captured (see print.c), saving a fork and a pipe.  the check is
+ *	conservative: any assignment, local, redirection, program, or
+ *	command whose name is not a literal word makes a body impure,
+ *	as does a binding of an fn- variable, since that would make the
+ *	function definitions seen here differ from those which run.
+ *	primitives such as if run the closures they are passed, so a
+ *	variable or call among their arguments, whose value cannot be
+ *	checked here, is impure too.
+ */
+
+#define	PUREDEPTH	8	/* how deeply to follow function definitions */
+
+static const char *pureprims[] = {
+	"arith", "arithtest", "catch", "count", "echo", "flatten", "fsplit",
+	"if", "noreturn", "result", "seq", "split", "var", NULL
+};
+
+static const char *runprims[] = {	/* the pure ones which run their arguments */
+	"catch", "if", "noreturn", "seq", NULL
+};
+
+static Boolean purecmd(Tree *tree, Binding *binding, int depth);
+static Boolean pureword(Tree *tree, Binding *binding, int depth);
+static Boolean purefn(List *fn, int depth);
+
+/* inprims -- is a primitive in a list? */
+static Boolean inprims(const char **prims, const char *name) {
+	int i;
+	for (i = 0; prims[i] != NULL; i++)
+		if (streq(prims[i], name))
+			return TRUE;
+	return FALSE;
+}
+
+/* pureprim -- is this primitive free of effects besides printing? */
+static Boolean pureprim(const char *name) {
+	return inprims(pureprims, name);
+}
+
+/* runsargs -- might the command named by this word run its arguments as code? */
+static Boolean runsargs(Tree *tree, Binding *binding) {
+	switch (tree->kind) {
+	    case nWord: case nQword: {
+		List *fn = varlookup2("fn-", tree->u[0].s, binding);
+		Closure *cp;
+		if (fn == NULL || !isclosure(fn->term))
+			return FALSE;
+		cp = getclosure(fn->term);
+		return cp->tree->kind == nPrim && inprims(runprims, cp->tree->u[0].s);
+	    }
+	    case nPrim:
+		return inprims(runprims, tree->u[0].s);
+	    default:
+		return FALSE;	/* functions are checked where they use their arguments */
+	}
+}
+
+/* fixedword -- is this word's value known without looking up variables or running code? */
+static Boolean fixedword(Tree *tree) {
+	if (tree == NULL)
+		return TRUE;
+	switch (tree->kind) {
+	    case nVar: case nVarsub: case nCall:
+		return FALSE;
+	    case nConcat: case nList:
+		return fixedword(tree->u[0].p) && fixedword(tree->u[1].p);
+	    default:
+		return TRUE;
+	}
+}
+
+/* purenames -- are these literal names which do not bind functions? */
+static Boolean purenames(Tree *tree) {
+	if (tree == NULL)
+		return TRUE;
+	switch (tree->kind) {
+	    case nWord: case nQword:
+		return !hasprefix(tree->u[0].s, "fn-");
+	    case nList:
+		return purenames(tree->u[0].p) && purenames(tree->u[1].p);
+	    default:
+		return FALSE;
+	}
+}
+
+/* purebindings -- are these let or for bindings pure? */
+static Boolean purebindings(Tree *defn, Binding *binding, int depth) {
+	for (; defn != NULL; defn = defn->u[1].p) {
+		Tree *assign = defn->u[0].p;
+		if (assign != NULL
+		    && (!purenames(assign->u[0].p)
+			|| !pureword(assign->u[1].p, binding, depth)))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* pureword -- can this word be glommed, and any closures in it run, purely? */
+static Boolean pureword(Tree *tree, Binding *binding, int depth) {
+	if (tree == NULL)
+		return TRUE;
+	switch (tree->kind) {
+	    case nWord: case nQword: case nPrim:
+		return TRUE;
+	    case nThunk:
+		return purecmd(tree->u[0].p, binding, depth);
+	    case nLambda:
+		return purenames(tree->u[0].p)
+		    && purecmd(tree->u[1].p, binding, depth);
+	    case nVar:
+		return pureword(tree->u[0].p, binding, depth);
+	    case nCall:
+		return purecmd(tree->u[0].p, binding, depth);
+	    case nVarsub: case nConcat: case nList:
+		return pureword(tree->u[0].p, binding, depth)
+		    && pureword(tree->u[1].p, binding, depth);
+	    default:
+		return FALSE;
+	}
+}
+
+/* purehead -- is the command named by this word pure? */
+static Boolean purehead(Tree *tree, Binding *binding, int depth) {
+	switch (tree->kind) {
+	    case nWord: case nQword: {
+		List *fn = varlookup2("fn-", tree->u[0].s, binding);
+		return fn != NULL && purefn(fn, depth + 1);
+	    }
+	    case nPrim:
+		return pureprim(tree->u[0].s);
+	    case nThunk: case nLambda:
+		return pureword(tree, binding, depth);
+	    default:
+		return FALSE;
+	}
+}
+
+/* purecmd -- can this command be run purely? */
+static Boolean purecmd(Tree *tree, Binding *binding, int depth) {
+	if (tree == NULL)
+		return TRUE;
+	switch (tree->kind) {
+	    case nList:
+		return purehead(tree->u[0].p, binding, depth)
+		    && pureword(tree->u[1].p, binding, depth)
+		    && (!runsargs(tree->u[0].p, binding) || fixedword(tree->u[1].p));
+	    case nWord: case nQword: case nPrim: case nThunk: case nLambda:
+		return purehead(tree, binding, depth);
+	    case nLet: case nFor:
+		return purebindings(tree->u[0].p, binding, depth)
+		    && purecmd(tree->u[1].p, binding, depth);
+	    case nMatch: case nExtract:
+		return pureword(tree->u[0].p, binding, depth)
+		    && pureword(tree->u[1].p, binding, depth);
+	    default:
+		return FALSE;
+	}
+}
+
+/* purefn -- can this list of closures and words be run purely as a command? */
+static Boolean purefn(List *fn, int depth) {
+	Closure *cp;
+	if (depth > PUREDEPTH || !isclosure(fn->term))
+		return FALSE;
+	cp = getclosure(fn->term);
+	if (cp->tree->kind != nPrim || !pureprim(cp->tree->u[0].s)) {
+		if (cp->tree->kind != nThunk && cp->tree->kind != nLambda)
+			return FALSE;
+		if (!pureword(cp->tree, cp->binding, depth))
+			return FALSE;
+	}
+	for (fn = fn->next; fn != NULL; fn = fn->next)
+		if (isclosure(fn->term)) {
+			cp = getclosure(fn->term);
+			if (!pureword(cp->tree, cp->binding, depth))
+				return FALSE;
+		}
+	return TRUE;
+}
+
+/*
+ * uncaught -- report an exception which escaped a backquote body run in
+ *	the shell the way a child would, in main(), and return the status
+ *	the child would have exited with
+ */
+static int uncaught(List *e) {
+	if (termeq(e->term, "exit"))
+		return exitstatus(e->next);
+	if (termeq(e->term, "error"))
+		eprint("%L\n", e->next == NULL ? NULL : e->next->next, " ");
+	else
+		eprint("uncaught exception: %L\n", e, " ");
+	return 1;
+}
+
+/*
+ * bqshell -- run a pure backquote body in the shell; FALSE if it must
+ *	be forked.  once the body has started it is never run again, so
+ *	an exception ends it as it would end a child.
+ */
+static Boolean bqshell(List *lp0, char *sep0, List **resultp, int evalflags) {
+	Buffer *outer, *volatile buf = NULL;
+	volatile int status = 0;
+
+	if ((evalflags & eval_exitonfalse) || lp0 == NULL
+	    || !purefn(lp0, 0))
+		return FALSE;
+
+	Ref(List *, lp, lp0);
+	Ref(char *, sep, sep0);
+	outer = capture(openbuffer(0));
+
+	ExceptionHandler
+		status = exitstatus(eval(lp, NULL, evalflags & ~eval_inchild));
+		buf = capture(outer);
+	CatchException (e)
+		buf = capture(outer);
+		if (termeq(e->term, "signal")) {
+			freebuffer(buf);
+			throw(e);
+		}
+		status = uncaught(e);
+	EndExceptionHandler
+
+	gcdisable();
+	startsplit(sep, TRUE);
+	splitstring(buf->str, buf->current, FALSE);
+	freebuffer(buf);
+	lp = mklist(mkstr(mkstatus(status << 8)), endsplit());
+	gcenable();
+	*resultp = lp;
+	RefEnd2(sep, lp);
+	return TRUE;
+}
+
 PRIM(backquote) {
 	int pid, p[2], status;
 
@@ -387,6 +784,11 @@ PRIM(backquote) {
 	Ref(char *, sep, getstr(lp->term));
 	lp = lp->next;
 
+	if (bqshell(lp, sep, &list, evalflags)) {
+		RefPop2(sep, lp);
+		return list;
+	}
+
 	if ((pid = pipefork(p, NULL)) == 0) {
 		mvfd(p[1], 1);
 		close(p[0]);
@@ -457,6 +859,9 @@ extern Dict *initprims_io(Dict *primdict) {
 	X(close);
 	X(dup);
 	X(pipe);
+#if HAVE_POLL && HAVE_POLL_H
+	X(parallel);
+#endif
 	X(backquote);
 	X(newfd);
 	X(here);
@@ -0,0 +1,308 @@
+/* prim-math.c -- arithmetic primitives ($Revision: 1.1 $) */
+
+#include "es.h"
+#include "prim.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+/*
+ * numbers
+ *	values are longs unless a literal was written with a decimal
+ *	point or an exponent, in which case the expression is carried
+ *	out in doubles from that point on.  integer overflow is an
+ *	error rather than a silent wrap.
+ */
+
+typedef struct {
+	Boolean isfloat;
+	long i;
+	double f;
+} Num;
+
+#define	FLOATOF(n)	((n).isfloat ? (n).f : (double) (n).i)
+#define	ISTRUE(n)	((n).isfloat ? (n).f != 0.0 : (n).i != 0)
+
+static Num mkint(long i) {
+	Num n;
+	n.isfloat = FALSE;
+	n.i = i;
+	n.f = 0.0;
+	return n;
+}
+
+static Num mkfloat(double f) {
+	Num n;
+	n.isfloat = TRUE;
+	n.i = 0;
+	n.f = f;
+	return n;
+}
+
+/*
+ * tokens
+ */
+
+typedef enum {
+	tEnd, tNum, tLparen, tRparen,
+	tOr, tAnd, tBitor, tBitxor, tBitand, tEq, tNe,
+	tLt, tLe, tGt, tGe, tShl, tShr, tAdd, tSub, tMul, tDiv, tMod,
+	tNot, tCompl
+} Token;
+
+static const struct { const char *name; Token tok; } ops[] = {
+	{ "||", tOr }, { "&&", tAnd }, { "==", tEq }, { "!=", tNe },
+	{ "<=", tLe }, { ">=", tGe }, { "<<", tShl }, { ">>", tShr },
+	{ "|", tBitor }, { "^", tBitxor }, { "&", tBitand }, { "=", tEq },
+	{ "<", tLt }, { ">", tGt }, { "+", tAdd }, { "-", tSub },
+	{ "*", tMul }, { "/", tDiv }, { "%", tMod }, { "!", tNot },
+	{ "~", tCompl }, { "(", tLparen }, { ")", tRparen },
+	/* word forms, which need no quoting from the shell */
+	{ "lt", tLt }, { "le", tLe }, { "gt", tGt }, { "ge", tGe },
+	{ "eq", tEq }, { "ne", tNe },
+	{ NULL, tEnd }
+};
+
+/* binding strength of each binary operator, as in C; 0 for non-operators */
+static int precedence(Token t) {
+	switch (t) {
+	case tOr:					return 1;
+	case tAnd:					return 2;
+	case tBitor:					return 3;
+	case tBitxor:					return 4;
+	case tBitand:					return 5;
+	case tEq: case tNe:				return 6;
+	case tLt: case tLe: case tGt: case tGe:		return 7;
+	case tShl: case tShr:				return 8;
+	case tAdd: case tSub:				return 9;
+	case tMul: case tDiv: case tMod:		return 10;
+	default:					return 0;
+	}
+}
+
+static const char *input;	/* the remainder of the expression */
+static const char *tokstart;	/* where the current token began */
+static Token tok;		/* the current token */
+static Num tokval;		/* its value, if it is a number */
+
+static void arithfail(const char *msg) {
+	fail("$&arith", "arith: %s", msg);
+}
+
+static void scan(void) {
+	int i;
+	size_t len;
+	char *end;
+	while (isspace((unsigned char) *input))
+		input++;
+	tokstart = input;
+	if (*input == '\0') {
+		tok = tEnd;
+		return;
+	}
+	if (isdigit((unsigned char) *input) || (*input == '.' && isdigit((unsigned char) input[1]))) {
+		long l;
+		errno = 0;
+		if (input[0] == '0' && (input[1] == 'x' || input[1] == 'X'))
+			l = strtol(input, &end, 16);
+		else
+			l = strtol(input, &end, 10);
+		if (*end == '.' || *end == 'e' || *end == 'E') {
+			errno = 0;
+			tokval = mkfloat(strtod(input, &end));
+			if (errno == ERANGE)
+				fail("$&arith", "arith: %s: number out of range", tokstart);
+		} else {
+			if (errno == ERANGE)
+				arithfail("integer overflow");
+			tokval = mkint(l);
+		}
+		if (isalnum((unsigned char) *end) || *end == '.')
+			fail("$&arith", "arith: bad number: %s", tokstart);
+		input = end;
+		tok = tNum;
+		return;
+	}
+	for (i = 0; ops[i].name != NULL; i++) {
+		len = strlen(ops[i].name);
+		if (strncmp(input, ops[i].name, len) == 0
+		    && (!isalpha((unsigned char) *input) || !isalnum((unsigned char) input[len]))) {
+			input += len;
+			tok = ops[i].tok;
+			return;
+		}
+	}
+	fail("$&arith", "arith: unexpected input: %s", tokstart);
+}
+
+static long needint(Num n) {
+	if (n.isfloat)
+		arithfail("integer operand required");
+	return n.i;
+}
+
+/* binary -- apply a binary operator; errors are only reported for live operands */
+static Num binary(Token op, Num a, Num b, Boolean live) {
+	long x, y;
+	if (!live)
+		return mkint(0);
+	switch (op) {
+	case tOr:	return mkint(ISTRUE(a) || ISTRUE(b));
+	case tAnd:	return mkint(ISTRUE(a) && ISTRUE(b));
+	case tEq:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) == FLOATOF(b) : a.i == b.i);
+	case tNe:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) != FLOATOF(b) : a.i != b.i);
+	case tLt:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) < FLOATOF(b) : a.i < b.i);
+	case tLe:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) <= FLOATOF(b) : a.i <= b.i);
+	case tGt:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) > FLOATOF(b) : a.i > b.i);
+	case tGe:	return mkint(a.isfloat || b.isfloat ? FLOATOF(a) >= FLOATOF(b) : a.i >= b.i);
+	default:	break;
+	}
+	if (a.isfloat || b.isfloat)
+		switch (op) {
+		case tAdd:	return mkfloat(FLOATOF(a) + FLOATOF(b));
+		case tSub:	return mkfloat(FLOATOF(a) - FLOATOF(b));
+		case tMul:	return mkfloat(FLOATOF(a) * FLOATOF(b));
+		case tDiv:
+			if (FLOATOF(b) == 0.0)
+				arithfail("division by zero");
+			return mkfloat(FLOATOF(a) / FLOATOF(b));
+		default:	break;
+		}
+	x = needint(a);
+	y = needint(b);
+	switch (op) {
+	case tBitor:	return mkint(x | y);
+	case tBitxor:	return mkint(x ^ y);
+	case tBitand:	return mkint(x & y);
+	case tShl:
+	case tShr:
+		if (y < 0 || y >= (long) (sizeof (long) * CHAR_BIT))
+			arithfail("shift count out of range");
+		return mkint(op == tShl ? (long) ((unsigned long) x << y) : x >> y);
+	case tAdd:
+		if (y > 0 ? x > LONG_MAX - y : x < LONG_MIN - y)
+			arithfail("integer overflow");
+		return mkint(x + y);
+	case tSub:
+		if (y < 0 ? x > LONG_MAX + y : x < LONG_MIN + y)
+			arithfail("integer overflow");
+		return mkint(x - y);
+	case tMul:
+		if (x > 0
+		    ? (y > 0 ? x > LONG_MAX / y : y < LONG_MIN / x)
+		    : (y > 0 ? x < LONG_MIN / y : (x != 0 && y < LONG_MAX / x)))
+			arithfail("integer overflow");
+		return mkint(x * y);
+	case tDiv:
+	case tMod:
+		if (y == 0)
+			arithfail("division by zero");
+		if (y == -1)	/* LONG_MIN / -1 overflows */
+			return op == tMod ? mkint(0) : binary(tSub, mkint(0), a, live);
+		return mkint(op == tDiv ? x / y : x % y);
+	default:
+		NOTREACHED;
+		return mkint(0);
+	}
+}
+
+static Num expr(int minprec, Boolean live);
+
+static Num primary(Boolean live) {
+	Num n;
+	Token op = tok;
+	switch (op) {
+	case tNum:
+		n = tokval;
+		scan();
+		return n;
+	case tLparen:
+		scan();
+		n = expr(1, live);
+		if (tok != tRparen)
+			arithfail("missing )");
+		scan();
+		return n;
+	case tAdd:
+	case tSub:
+	case tNot:
+	case tCompl:
+		scan();
+		n = primary(live);
+		if (!live)
+			return n;
+		switch (op) {
+		case tSub:	return n.isfloat ? mkfloat(-n.f) : binary(tSub, mkint(0), n, live);
+		case tNot:	return mkint(!ISTRUE(n));
+		case tCompl:	return mkint(~needint(n));
+		default:	return n;
+		}
+	case tEnd:
+		arithfail("missing operand");
+		NOTREACHED;
+	default:
+		fail("$&arith", "arith: unexpected operator: %s", tokstart);
+		NOTREACHED;
+	}
+	return mkint(0);
+}
+
+/* expr -- precedence climbing; && and || only evaluate what they need to */
+static Num expr(int minprec, Boolean live) {
+	int prec;
+	Num lhs = primary(live), rhs;
+	while ((prec = precedence(tok)) >= minprec) {
+		Token op = tok;
+		Boolean rlive = live;
+		if (op == tAnd)
+			rlive = live && ISTRUE(lhs);
+		else if (op == tOr)
+			rlive = live && !ISTRUE(lhs);
+		scan();
+		rhs = expr(prec + 1, rlive);
+		if (op == tAnd || op == tOr)
+			lhs = mkint(live && (op == tAnd ? rlive && ISTRUE(rhs) : !rlive || ISTRUE(rhs)));
+		else
+			lhs = binary(op, lhs, rhs, live);
+	}
+	return lhs;
+}
+
+/* evaluate -- parse and evaluate the arguments as a single expression */
+static Num evaluate(List *list) {
+	Num n;
+	if (list == NULL)
+		fail("$&arith", "usage: arith expression");
+	input = str("%L", list, " ");
+	scan();
+	n = expr(1, TRUE);
+	if (tok != tEnd)
+		fail("$&arith", "arith: unexpected input: %s", tokstart);
+	return n;
+}
+
+PRIM(arith) {
+	Num n = evaluate(list);
+	if (n.isfloat) {
+		char buf[64];
+		sprintf(buf, "%.15g", n.f);
+		return mklist(mkstr(gcdup(buf)), NULL);
+	}
+	return mklist(mkstr(str("%ld", n.i)), NULL);
+}
+
+PRIM(arithtest) {
+	Num n = evaluate(list);
+	return ISTRUE(n) ? ltrue : lfalse;
+}
+
+
+/*
+ * initialization
+ */
+
+extern Dict *initprims_math(Dict *primdict) {
+	XE(arith);
+	XE(arithtest);
+	return primdict;
+}
@@ -5,11 +5,18 @@
 
 static Dict *prims;
 
-extern List *prim(char *s, List *list, int evalflags) {
+extern Prim *getprim(char *s) {
 	Prim *p;
 	p = (Prim *) dictget(prims, s);
 	if (p == NULL)
 		fail("es:prim", "unknown primitive: %s", s);
+	return p;
+}
+
+extern List *prim(char *s, List *list, int evalflags) {
+	Prim *p = getprim(s);
+	if (!p->escapes)
+		evalflags &= ~eval_escape;
 	return (p->prim)(list, evalflags);
 }
 
@@ -44,6 +51,7 @@ extern void initprims(void) {
 	prims = initprims_controlflow(prims);
 	prims = initprims_io(prims);
 	prims = initprims_etc(prims);
+	prims = initprims_math(prims);
 	prims = initprims_sys(prims);
 	prims = initprims_proc(prims);
 	prims = initprims_access(prims);
@@ -1,6 +1,7 @@
 /* print.c -- formatted printing routines ($Revision: 1.1.1.1 $) */
 
 #include "es.h"
+#include "gc.h"
 #include "print.h"
 
 #define	MAXCONV 256
@@ -294,12 +295,35 @@ extern int fmtprint VARARGS2(Format *, format, const char *, fmt) {
 	return n + format->flushed;
 }
 
+/*
+ * output capture
+ *	while a buffer is installed here, what is printed on file
+ *	descriptor 1 is appended to it instead of being written.  a
+ *	backquote whose body can run in the shell itself uses this in
+ *	place of a pipe and a child process.
+ */
+
+#define	CAPTURED	(-2)		/* the fd of a format printing to the buffer */
+
+static Buffer *capturebuf = NULL;
+
+/* capture -- install a buffer for output on fd 1, returning the previous one */
+extern Buffer *capture(Buffer *buf) {
+	Buffer *old = capturebuf;
+	capturebuf = buf;
+	return old;
+}
+
 static int fprint_flush(Format *format, size_t UNUSED more) {
 	size_t n = format->buf - format->bufbegin;
 	char *buf = format->bufbegin;
 
 	format->flushed += n;
 	format->buf = format->bufbegin;
+	if (format->u.n == CAPTURED) {
+		capturebuf = bufncat(capturebuf, buf, n);
+		return 0;
+	}
 	while (n != 0) {
 		int written = write(format->u.n, buf, n);
 		if (written == -1)
@@ -318,7 +342,7 @@ static int fdprint(Format *format, int fd, const char *fmt) {
 	format->bufend	= buf + sizeof buf;
 	format->grow	= fprint_flush;
 	format->flushed	= 0;
-	format->u.n	= fdmap(fd);
+	format->u.n	= (fd == 1 && capturebuf != NULL) ? CAPTURED : fdmap(fd);
 
 	gcdisable();
 	printfmt(format, fmt);
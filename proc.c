@@ -8,10 +8,26 @@ typedef struct Proc Proc;
 struct Proc {
 	int pid;
 	Boolean background;
-	Proc *next, *prev;
+	Boolean alive;		/* false for an unclaimed status */
+	int status;		/* the status of a dead child */
+	Proc *hashnext;		/* the next process in this slot of proctab */
+	Proc *next, *prev;	/* the list of background jobs, newest first */
 };
 
-static Proc *proclist = NULL;
+/*
+ * the process table
+ *	children are kept in a hash table indexed by pid, so finding
+ *	one as it is reaped does not depend on how many there are, and
+ *	background jobs are also kept on a list for $&apids.  a child
+ *	the shell did not start, reaped by a wait for any process, stays
+ *	behind as a dead entry until a wait for its pid claims the status.
+ */
+
+#define	PROCSLOT(pid)	(((unsigned int) (pid)) & (procsize - 1))
+
+static Proc **proctab = NULL;
+static int procsize = 0, proccount = 0;
+static Proc *bglist = NULL;
 
 static int ttyfd = -1;
 static pid_t espgid;
@@ -19,34 +35,95 @@ static pid_t espgid;
 static pid_t tcpgid0;
 #endif
 
-/* mkproc -- create a Proc structure */
-extern Proc *mkproc(int pid, Boolean background) {
-	Proc *proc = ealloc(sizeof (Proc));
-	proc->next = proclist;
+/* growproctab -- double the size of the process table */
+static void growproctab(void) {
+	int i, oldsize = procsize;
+	Proc **old = proctab, *proc, *next;
+	procsize = (procsize == 0) ? 16 : procsize * 2;
+	proctab = ealloc(procsize * sizeof (Proc *));
+	memzero(proctab, procsize * sizeof (Proc *));
+	for (i = 0; i < oldsize; i++)
+		for (proc = old[i]; proc != NULL; proc = next) {
+			next = proc->hashnext;
+			proc->hashnext = proctab[PROCSLOT(proc->pid)];
+			proctab[PROCSLOT(proc->pid)] = proc;
+		}
+	if (old != NULL)
+		efree(old);
+}
+
+/* findproc -- return the link to a live or dead entry for pid, or NULL */
+static Proc **findproc(int pid, Boolean alive) {
+	Proc *proc, **procp;
+	if (procsize == 0)
+		return NULL;
+	for (procp = &proctab[PROCSLOT(pid)]; (proc = *procp) != NULL; procp = &proc->hashnext)
+		if (proc->pid == pid && proc->alive == alive)
+			return procp;
+	return NULL;
+}
+
+/* claim -- remove the unclaimed status for pid from the table and return it, or NULL */
+static Proc *claim(int pid) {
+	Proc *proc, **procp = findproc(pid, FALSE);
+	if (procp == NULL)
+		return NULL;
+	proc = *procp;
+	*procp = proc->hashnext;
+	proccount--;
+	return proc;
+}
+
+/* addproc -- add a new child to the process table */
+static Proc *addproc(int pid, Boolean background) {
+	Proc *proc;
+	if ((proc = claim(pid)) == NULL)	/* the pid has been reused */
+		proc = ealloc(sizeof (Proc));
+	if (proccount >= procsize)
+		growproctab();
 	proc->pid = pid;
 	proc->background = background;
+	proc->alive = TRUE;
+	proc->status = 0;
+	proc->hashnext = proctab[PROCSLOT(pid)];
+	proctab[PROCSLOT(pid)] = proc;
+	proccount++;
 	proc->prev = NULL;
+	proc->next = NULL;
+	if (background) {
+		proc->next = bglist;
+		if (bglist != NULL)
+			bglist->prev = proc;
+		bglist = proc;
+	}
 	return proc;
 }
 
+/* clearproctab -- forget all children, as a new child does */
+static void clearproctab(void) {
+	int i;
+	Proc *proc, *next;
+	for (i = 0; i < procsize; i++) {
+		for (proc = proctab[i]; proc != NULL; proc = next) {
+			next = proc->hashnext;
+			efree(proc);
+		}
+		proctab[i] = NULL;
+	}
+	proccount = 0;
+	bglist = NULL;
+}
+
 /* efork -- fork (if necessary) and clean up as appropriate */
 extern int efork(Boolean parent, Boolean background) {
 	if (parent) {
 		int pid = fork();
 		switch (pid) {
-		default: {	/* parent */
-			Proc *proc = mkproc(pid, background);
-			if (proclist != NULL)
-				proclist->prev = proc;
-			proclist = proc;
+		default:	/* parent */
+			addproc(pid, background);
 			return pid;
-		}
 		case 0:		/* child */
-			while (proclist != NULL) {
-				Proc *p = proclist;
-				proclist = proclist->next;
-				efree(p);
-			}
+			clearproctab();
 			hasforked = TRUE;
 #if JOB_PROTECT
 			tcpgid0 = 0;
@@ -62,6 +139,36 @@ extern int efork(Boolean parent, Boolean background) {
 	return 0;
 }
 
+#if USE_SPAWN
+/*
+ * espawn -- start a program as efork() and execve() would, without
+ *	copying the shell, or return -1 if the caller should do that
+ *	itself.  if the exec fails, so does the spawn, and the fork path
+ *	then reports the error (or runs %exec-failure) in a real child.
+ */
+extern int espawn(char *file, char **argv, char **envp) {
+	pid_t pid = -1;
+	sigset_t defaults;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+
+	if (posix_spawn_file_actions_init(&actions) != 0)
+		return -1;
+	if (spawnfds(&actions) && posix_spawnattr_init(&attr) == 0) {
+		sigdefaultset(&defaults);
+		if (posix_spawnattr_setsigdefault(&attr, &defaults) != 0
+		    || posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF) != 0
+		    || posix_spawn(&pid, file, &actions, &attr, argv, envp) != 0)
+			pid = -1;
+		posix_spawnattr_destroy(&attr);
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	if (pid != -1)
+		addproc(pid, FALSE);
+	return pid;
+}
+#endif
+
 extern pid_t spgrp(pid_t pgid) {
 	pid_t old = getpgrp();
 	setpgid(0, pgid);
@@ -116,41 +223,62 @@ extern Noreturn esexit(int code) {
 }
 #endif
 
-/* reap -- mark a process as dead and return it */
+/* reap -- remove a dead process from the table and return it, or NULL if it is not ours */
 static Proc *reap(int pid) {
-	Proc *proc;
-	for (proc = proclist; proc != NULL; proc = proc->next)
-		if (proc->pid == pid)
-			break;
-	assert(proc != NULL);
-	if (proc->next != NULL)
-		proc->next->prev = proc->prev;
-	if (proc->prev != NULL)
-		proc->prev->next = proc->next;
-	else
-		proclist = proc->next;
+	Proc *proc, **procp = findproc(pid, TRUE);
+	if (procp == NULL)
+		return NULL;
+	proc = *procp;
+	*procp = proc->hashnext;
+	proccount--;
+	if (proc->background) {
+		if (proc->next != NULL)
+			proc->next->prev = proc->prev;
+		if (proc->prev != NULL)
+			proc->prev->next = proc->next;
+		else
+			bglist = proc->next;
+	}
 	return proc;
 }
 
-/* ewait -- wait for a specific process to die, or any process if pid == -1 */
+/*
+ * ewait -- wait for a specific process to die, or any process if pid == -1
+ *	children the shell did not start itself (say, ones inherited
+ *	through exec) are passed over by a wait for any process, but
+ *	their statuses are kept for a later wait for their pids.
+ */
 extern int ewait(int pidarg, Boolean interruptible) {
 	int deadpid, status;
 	Proc *proc;
-	while ((deadpid = waitpid(pidarg, &status, 0)) == -1) {
-		if (errno == ECHILD && pidarg > 0)
-			fail("es:ewait", "wait: %d is not a child of this shell", pidarg);
-		else if (errno != EINTR)
-			fail("es:ewait", "wait: %s", esstrerror(errno));
-		if (interruptible)
-			SIGCHK();
+	if (pidarg > 0 && (proc = claim(pidarg)) != NULL) {
+		status = proc->status;
+		efree(proc);
+		return status;
+	}
+	for (;;) {
+		while ((deadpid = waitpid(pidarg, &status, 0)) == -1) {
+			if (errno == ECHILD && pidarg > 0)
+				fail("es:ewait", "wait: %d is not a child of this shell", pidarg);
+			else if (errno != EINTR)
+				fail("es:ewait", "wait: %s", esstrerror(errno));
+			if (interruptible)
+				SIGCHK();
+		}
+		if ((proc = reap(deadpid)) != NULL || pidarg != -1)
+			break;
+		proc = addproc(deadpid, FALSE);
+		proc->alive = FALSE;
+		proc->status = status;
 	}
-	proc = reap(deadpid);
 #if JOB_PROTECT
 	tctakepgrp();
 #endif
-	if (proc->background)
-		printstatus(proc->pid, status);
-	efree(proc);
+	if (proc != NULL) {
+		if (proc->background)
+			printstatus(proc->pid, status);
+		efree(proc);
+	}
 	return status;
 }
 
@@ -159,11 +287,10 @@ extern int ewait(int pidarg, Boolean interruptible) {
 PRIM(apids) {
 	Proc *p;
 	Ref(List *, lp, NULL);
-	for (p = proclist; p != NULL; p = p->next)
-		if (p->background) {
-			Term *t = mkstr(str("%d", p->pid));
-			lp = mklist(t, lp);
-		}
+	for (p = bglist; p != NULL; p = p->next) {
+		Term *t = mkstr(str("%d", p->pid));
+		lp = mklist(t, lp);
+	}
 	/* TODO: sort the return value, but by number? */
 	RefReturn(lp);
 }
@@ -219,6 +219,19 @@ extern void setsigdefaults(void) {
 	}
 }
 
+#if USE_SPAWN
+/* sigdefaultset -- the signals setsigdefaults() would reset, for posix_spawn */
+extern void sigdefaultset(sigset_t *set) {
+	int sig;
+	sigemptyset(set);
+	for (sig = 1; sig < NSIG; sig++) {
+		Sigeffect e = sigeffect[sig];
+		if (e == sig_catch || e == sig_noop || e == sig_special)
+			sigaddset(set, sig);
+	}
+}
+#endif
+
 
 /*
  * utility functions
@@ -58,6 +58,10 @@
 #include <sys/ioctl.h>
 #endif
 
+#if USE_SPAWN
+#include <spawn.h>
+#endif
+
 #if REQUIRE_STAT
 #include <sys/stat.h>
 #endif
@@ -86,6 +90,10 @@ extern Dirent *readdir(DIR *);
 #include <fcntl.h>
 #endif
 
+#if REQUIRE_POLL && HAVE_POLL_H
+#include <poll.h>
+#endif
+
 /* stdlib */
 #ifndef Noreturn
 #if __GNUC__
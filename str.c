@@ -105,7 +105,7 @@ extern char *mprint VARARGS1(const char *, fmt) {
  *	to even include these is probably a premature optimization
  */
 
-DefineTag(StrList, static);
+DefineCellTag(StrList, static);
 
 extern StrList *mkstrlist(char *str, StrList *next) {
 	gcdisable();
@@ -76,8 +76,18 @@ extern Tree *fnassign(Tree *name, Tree *defn) {
 	return mk(nAssign, mk(nConcat, mk(nWord, "fn-"), name), defn);
 }
 
+/* mkname -- intern a literal word used as a name, so that looking it up compares pointers */
+extern Tree *mkname(Tree *t) {
+	if (t != NULL && t->kind == nWord)
+		t->u[0].s = intern(t->u[0].s);
+	return t;
+}
+
 /* mklambda -- create a lambda */
 extern Tree *mklambda(Tree *params, Tree *body) {
+	Tree *t;
+	for (t = params; t != NULL; t = t->CDR)
+		t->CAR->u[0].s = intern(t->CAR->u[0].s);
 	return mk(nLambda, params, body);
 }
 
@@ -264,3 +274,130 @@ extern Tree *firstprepend(Tree *first, Tree *args) {
 		return args;
 	return *tp;
 }
+
+/*
+ * lexical resolution
+ *	a $name reference whose binding is introduced by an enclosing
+ *	let, for, lambda or %closure in the same tree is marked with its
+ *	distance down the binding chain, so glom can go straight to it
+ *	instead of comparing names all the way down.  the distance is
+ *	only a hint: glom checks the name of the binding it lands on and
+ *	searches by name as before if it is wrong.  binders whose names
+ *	are not known until run time are opaque, and nothing is resolved
+ *	past them.
+ */
+
+#define	OPAQUE	NULL
+
+static char **scope = NULL;
+static int scopesize = 0, scopedepth = 0;
+
+static void scopepush(char *name) {
+	if (scopedepth == scopesize) {
+		scopesize = (scopesize == 0) ? 64 : scopesize * 2;
+		scope = erealloc(scope, scopesize * sizeof (char *));
+	}
+	scope[scopedepth++] = name;
+}
+
+/* distance -- how far down the binding chain name will be, or 0 if unknown */
+static int distance(char *name) {
+	int i;
+	if (*name == '\0' || isdigit((unsigned char) *name) || strchr(name, '=') != NULL)
+		return 0;
+	for (i = scopedepth; i-- > 0;) {
+		if (scope[i] == OPAQUE)
+			return 0;
+		if (scope[i] == name || streq(scope[i], name))
+			return scopedepth - i;
+	}
+	return 0;
+}
+
+/* literalname -- the variable named by a word, if it is fixed at parse time */
+static char *literalname(Tree *t) {
+	char *left, *right;
+	if (t == NULL)
+		return NULL;
+	switch (t->kind) {
+	case nWord: case nQword:
+		return t->u[0].s;
+	case nConcat:
+		if ((left = literalname(t->CAR)) == NULL || (right = literalname(t->CDR)) == NULL)
+			return NULL;
+		return intern(str("%s%s", left, right));
+	default:
+		return NULL;
+	}
+}
+
+static void resolve1(Tree *t);
+
+/* resolvebinder -- resolve a let, for or %closure, pushing the names it binds */
+static void resolvebinder(Tree *t) {
+	Tree *defn;
+	int depth = scopedepth;
+
+	if (t->kind == nClosure)
+		scopepush(OPAQUE);	/* extract() evaluates these without bindings */
+	for (defn = t->CAR; defn != NULL; defn = defn->CDR)
+		if (defn->CAR != NULL) {
+			resolve1(defn->CAR->CAR);
+			resolve1(defn->CAR->CDR);
+		}
+	scopedepth = depth;
+
+	for (defn = t->CAR; defn != NULL; defn = defn->CDR)
+		if (defn->CAR != NULL)
+			scopepush(literalname(defn->CAR->CAR));
+	resolve1(t->CDR);
+	scopedepth = depth;
+}
+
+static void resolve1(Tree *t) {
+	Tree *param;
+	int depth;
+
+	for (; t != NULL; t = t->CDR)
+		switch (t->kind) {
+		case nVar:
+			if (t->CAR == NULL)
+				return;
+			if (t->CAR->kind == nWord || t->CAR->kind == nQword)
+				t->u[1].i = distance(t->CAR->u[0].s);
+			else
+				resolve1(t->CAR);
+			return;
+		case nLambda:
+			depth = scopedepth;
+			if (t->CAR == NULL)
+				scopepush("*");
+			for (param = t->CAR; param != NULL; param = param->CDR)
+				scopepush(param->CAR->u[0].s);
+			resolve1(t->CDR);
+			scopedepth = depth;
+			return;
+		case nLet: case nFor: case nClosure:
+			resolvebinder(t);
+			return;
+		case nCall: case nThunk:
+			resolve1(t->CAR);
+			return;
+		case nList: case nConcat: case nAssign: case nLocal:
+		case nVarsub: case nMatch: case nExtract: case nRedir:
+			resolve1(t->CAR);
+			break;
+		default:
+			return;
+		}
+}
+
+/* resolve -- mark the lexically bound variable references in a parse tree */
+extern Tree *resolve(Tree *t) {
+	scopedepth = 0;
+	gcdisable();
+	resolve1(t);
+	gcenable();
+	assert(scopedepth == 0);
+	return t;
+}
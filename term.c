@@ -4,7 +4,83 @@
 #include "gc.h"
 #include "term.h"
 
-DefineTag(Term, static);
+DefineCellTag(Term, static);
+
+/*
+ * conversion caches
+ *	a term holds either a string or a closure, so using one as the
+ *	other means printing a closure or parsing code.  two small
+ *	direct-mapped caches remember recent conversions.  parses are
+ *	kept as trees, which extractbindings() reads without changing,
+ *	and each hit still extracts fresh bindings.  printed closures
+ *	stay good until some lexical variable is assigned, since that
+ *	may change a binding printed in them.
+ */
+
+#define	NCONVCACHE	64
+#define	PTRSLOT(p)	((((unsigned long) (p)) >> 4) & (NCONVCACHE - 1))
+
+static struct {
+	char *str;
+	Tree *tree;
+} parsecache[NCONVCACHE];
+
+static struct {
+	Closure *closure;
+	char *str;
+	unsigned long rebindings;
+} printcache[NCONVCACHE];
+
+static void initconvcache(void) {
+	static Boolean initialized = FALSE;
+	int i;
+	if (initialized)
+		return;
+	initialized = TRUE;
+	for (i = 0; i < NCONVCACHE; i++) {
+		globalroot(&parsecache[i].str);
+		globalroot(&parsecache[i].tree);
+		globalroot(&printcache[i].closure);
+		globalroot(&printcache[i].str);
+	}
+}
+
+/* parsecode -- parse the string form of a closure, remembering the tree */
+static Tree *parsecode(char *s) {
+	Tree *tree;
+	int slot = strhash(s) & (NCONVCACHE - 1);
+	initconvcache();
+	if (parsecache[slot].str != NULL && streq(parsecache[slot].str, s))
+		return parsecache[slot].tree;
+	Ref(char *, sp, s);
+	tree = parsestring(sp);
+	if (tree != NULL) {
+		parsecache[slot].str = sp;
+		parsecache[slot].tree = tree;
+	}
+	RefEnd(sp);
+	return tree;
+}
+
+/* printcode -- the string form of a closure */
+static char *printcode(Closure *closure) {
+	char *s;
+	int slot = PTRSLOT(closure);
+	initconvcache();
+	if (
+		   printcache[slot].closure == closure
+		&& (closure->binding == NULL || printcache[slot].rebindings == rebindings)
+	)
+		return printcache[slot].str;
+	Ref(Closure *, cp, closure);
+	s = str("%C", cp);
+	slot = PTRSLOT(cp);
+	printcache[slot].closure = cp;
+	printcache[slot].str = s;
+	printcache[slot].rebindings = rebindings;
+	RefEnd(cp);
+	return s;
+}
 
 extern Term *mkterm(char *str, Closure *closure) {
 	gcdisable();
@@ -36,7 +112,7 @@ extern Closure *getclosure(Term *term) {
 		) {
 			Closure *c;
 			Ref(Term *, tp, term);
-			Ref(Tree *, np, parsestring(s));
+			Ref(Tree *, np, parsecode(s));
 			if (np == NULL) {
 				RefPop2(np, tp);
 				return NULL;
@@ -44,6 +120,7 @@ extern Closure *getclosure(Term *term) {
 			c = extractbindings(np);
 			tp->closure = c;
 			tp->str = NULL;
+			gcremember(tp, c);
 			term = tp;
 			RefEnd2(np, tp);
 		}
@@ -66,7 +143,7 @@ extern char *getstr(Term *term) {
 	RefEnd(tp);
 	return s;
 #else
-	return str("%C", closure);
+	return printcode(closure);
 #endif
 }
 
@@ -80,6 +157,7 @@ extern Term *termcat(Term *t1, Term *t2) {
 	Ref(char *, str1, getstr(t1));
 	Ref(char *, str2, getstr(t2));
 	term->str = str("%s%s", str1, str2);
+	gcremember(term, term->str);
 	RefEnd2(str2, str1);
 	RefReturn(term);
 }
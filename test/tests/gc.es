@@ -0,0 +1,140 @@
+# tests/gc.es -- verify the garbage collector and its primitives
+
+test 'data survives collection' {
+	let (x = (); fn-f = @ a {result $a $a}) {
+		for (i = `{seq 1 200}) {
+			x = $x <={f $i}
+		}
+		$&collect
+		assert {~ $#x 400} 'list built across collections is intact'
+		assert {~ $x(1) 1 && ~ $x(399) 200} 'list contents are intact'
+		local (y = <={%fsplit , a,b,c}) {
+			$&collect
+			assert {~ $y (a b c)} 'local binding survives collection'
+		}
+	}
+}
+
+test 'large objects' {
+	let (big = ``() {seq 1 4000}) {
+		let (words = <={%fsplit \n $big}) {
+			$&collect
+			assert {~ $#words 4001 && ~ $words(4000) 4000} 'large string survives collection'
+			big = $big^end
+			$&collect
+			assert {~ $big *^\n^end} 'large string can be rebuilt'
+		}
+	}
+	local (manyvars = `{seq 1 4000}) {
+		assert {~ `{$es -c 'echo $#manyvars'} 4000} 'large environment is exported'
+	}
+}
+
+test 'gcstats' {
+	let (stats = <={$&gcstats}) {
+		assert {~ $stats(1) collections && ~ $stats(3) minor && ~ $stats(5) major}
+		assert {~ $stats(13) minpspace && ~ $stats(15) () pause-*us} 'names and values alternate'
+	}
+	$&collect
+	let (before = <={$&gcstats reset}; after = <={$&gcstats}) {
+		assert {!~ $before(2) 0} 'collections are counted'
+		assert {~ $before(6) [1-9]*} 'full collections are counted'
+		assert {expr $after(2) '<' $before(2) > /dev/null} 'reset zeroes the counters'
+	}
+	let (ex = ()) {
+		catch @ e {ex = $e} {
+			$&gcstats bogus
+		}
+		assert {~ $ex(1) error} 'bad arguments are rejected'
+	}
+}
+
+test 'freeze' {
+	let (n = ()) fn freeze-count {n = $n x; result $#n}
+	fn freeze-list {result a b c}
+	freeze-var = <={%fsplit , x,y,z}
+	$&freeze fn-freeze-count fn-freeze-list freeze-var nonexistent-var
+	$&collect
+	assert {~ <={freeze-count} 1 && ~ <={freeze-count} 2} 'frozen closures keep their bindings'
+	$&collect
+	assert {~ <={freeze-count} 3} 'bindings changed after freezing survive collection'
+	assert {~ <={freeze-list} (a b c) && ~ $freeze-var (x y z)} 'frozen definitions are intact'
+	freeze-var = new <={%fsplit , p,q}
+	$&collect
+	assert {~ $freeze-var (new p q)} 'frozen variables can be reassigned'
+	$&freeze
+	$&collect
+	assert {~ <={freeze-list} (a b c) && ~ $freeze-var (new p q)} 'freezing everything keeps all definitions'
+	fn-freeze-count = fn-freeze-list = freeze-var =
+}
+
+test 'heapcensus' {
+	let (census = <={$&heapcensus}) {
+		assert {~ $census(1) [A-Z]* && ~ $census(2) [1-9]* && ~ $census(3) [1-9]*} 'types, counts and bytes form triples'
+		assert {~ $census String} 'strings are counted'
+	}
+	census-big = ``() {seq 1 3000}
+	census-list = `{seq 1 1000}
+	let (largest = <={$&heapcensus largest 1}) {
+		assert {~ $largest(2) String && ~ $largest(3) census-big} 'the largest object is found with its variable'
+	}
+	assert {~ <={$&heapcensus vars 20} census-list} 'variables are charged for what they hold'
+	census-big = census-list =
+	let (ex = ()) {
+		catch @ e {ex = $e} {
+			$&heapcensus largest none
+		}
+		assert {~ $ex(1) error} 'bad counts are rejected'
+	}
+}
+
+test 'allocprofile' {
+	fn profile-inner {result <={%fsplit , a,b,c,d,e,f}}
+	fn profile-outer {for (i = 1 2 3 4 5 6 7 8) profile-inner}
+	$&allocprofile 64
+	profile-outer
+	$&allocprofile 0
+	let (samples = <={$&allocprofile}) {
+		assert {~ $samples *profile-outer\;*profile-inner\;*' '[1-9]*} 'samples are folded stacks'
+		assert {!~ $samples *profile-inner\;*profile-outer*} 'stacks are outermost first'
+	}
+	let (before = <={%flatten ' ' <={$&allocprofile}}) {
+		profile-outer
+		assert {~ <={%flatten ' ' <={$&allocprofile}} $before} 'nothing is sampled once profiling stops'
+	}
+	let (ex = ()) {
+		catch @ e {ex = $e} {
+			$&allocprofile often
+		}
+		assert {~ $ex(1) error} 'bad periods are rejected'
+	}
+	fn-profile-inner = fn-profile-outer =
+}
+
+test 'gc policy' {
+	local (gc-growth = 3; gc-max-pause = 500; gc-min-space = 1048576) {
+		assert {~ <={$&gcstats}(14) 1048576} 'gc-min-space sets the space size'
+		assert {~ $gc-growth 3 && ~ $gc-max-pause 500} 'policy variables keep their values'
+		let (x = `{seq 1 2000}) {
+			$&collect
+			assert {~ $#x 2000} 'data survives a tuned collector'
+		}
+	}
+	let (ex = ()) {
+		catch @ e {ex = $e} {
+			gc-growth = lots
+		}
+		assert {~ $ex(1) error && ~ $gc-growth ()} 'bad values are rejected'
+	}
+	let (ex = ()) {
+		catch @ e type msg {ex = $type} {
+			local (gc-max-heap = 100000) {
+				let (x = `{seq 1 20000}) {
+					$&collect
+					result $#x
+				}
+			}
+		}
+		assert {~ $ex es:memory} 'exceeding gc-max-heap raises es:memory'
+	}
+}
@@ -292,3 +292,364 @@ es} $es^' es'}
 	assert {~ `` \n {echo h\\i} 'h\i'}
 	assert {~ `` \n {echo h \\ i} 'h \ i'}
 }
+
+test 'computed names' {
+	let (name = computed-^name) {
+		$name = literal
+		assert {~ $computed-name literal} 'a computed name reaches a literal one'
+		computed-name = again
+		assert {~ $$name again} 'a literal name reaches a computed one'
+		fn-^$name = @ x {result called $x}
+		assert {~ <={computed-name y} (called y)} 'functions defined by computed names are found'
+		let ($name = bound)
+			assert {~ $computed-name bound && ~ $$name bound} 'lexical bindings are shared'
+		fn-$name = ; computed-name =
+	}
+}
+
+test 'lexical scope' {
+	let (x = outer; y = why)
+		let (x = inner; z = $x)
+			assert {~ $x inner && ~ $z outer && ~ $y why} 'let values see the enclosing scope'
+	let (f = @ a b {result $a $b $*}) {
+		assert {~ <={$f 1 2 3} (1 2 3)} 'parameters shadow and $* is not rebound'
+	}
+	let (g = @ {result $*})
+		assert {~ <={$g p q} (p q)} 'a lambda without parameters binds $*'
+	let (n = ()) {
+		for (i = a b; j = 1 2 3)
+			let (k = $i$j)
+				n = $n $k
+		assert {~ $n (a1 b2 3)} 'for loop variables are found from nested lets'
+	}
+	let (v = lex) {
+		local (v = dyn)
+			assert {~ $v lex} 'local does not hide a lexical binding'
+		let (name = v)
+			let ($name = computed)
+				assert {~ $v computed} 'computed names are searched for'
+		let (fn-h = @ {result $v})
+			let (v = other)
+				assert {~ <={h} lex} 'closures see their defining scope'
+	}
+	let (c = 1)
+		let (fn-counter = @ {c = `{expr $c + 1}; result $c}) {
+			counter
+			let (s = $fn-counter) {
+				fn-clone = $s
+				assert {~ <={clone} 3 && ~ $c 3} 'closures survive a round trip through a string'
+			}
+			fn-clone =
+		}
+}
+
+test 'exported environment' {
+	fn child {$es -c 'echo $envtest-a $envtest-b'}
+	envtest-a = one
+	assert {~ `child one} 'new variables are exported'
+	envtest-b = two
+	envtest-a = three
+	assert {~ `child (three two)} 'changed variables are updated'
+	envtest-a =
+	assert {~ `child two} 'removed variables leave the environment'
+	local (envtest-a = pushed)
+		assert {~ `child (pushed two)} 'local variables are exported'
+	assert {~ `child two} 'popped variables are restored'
+	local (noexport = envtest-b)
+		assert {~ `child ()} 'noexport is respected'
+	for (i = `{seq 1 100})
+		envtest-^$i = $i
+	assert {~ `{$es -c 'echo $envtest-1 $envtest-100'} (1 100)} 'many changes at once are exported'
+	for (i = `{seq 1 100})
+		envtest-^$i =
+	let (n = 1) {
+		fn envtest-count {result $n}
+		assert {~ `{$es -c 'echo <={envtest-count}'} 1}
+		n = 2
+		assert {~ `{$es -c 'echo <={envtest-count}'} 2} 'closures are re-exported when their bindings change'
+	}
+	envtest-b = fn-envtest-count = fn-child =
+}
+
+test 'variable table' {
+	for (i = `{seq 1 300})
+		tabletest-^$i = $i
+	let (before = <={$&dictstats}) {
+		for (i = `{seq 301 600})
+			tabletest-^$i = $i
+		assert {~ $before(11) symbols && ~ <={$&dictstats}(12) $before(12)} 'names built at run time are not interned'
+	}
+	for (i = `{seq 1 600 3})
+		tabletest-^$i =
+	let (ok = true) {
+		for (i = `{seq 1 600 3})
+			~ $(tabletest-^$i) () || ok = false
+		for (i = `{seq 2 600 3} `{seq 3 600 3})
+			~ $(tabletest-^$i) $i || ok = false
+		assert {$ok} 'removing variables leaves the rest reachable'
+	}
+	let (stats = <={$&dictstats}) {
+		assert {~ $stats(1) size && ~ $stats(3) entries && ~ $stats(9) meanprobe} 'names and values alternate'
+		assert {expr $stats(4) '<' $stats(2) > /dev/null} 'the table has room to spare'
+		assert {~ $stats(8) [1-9]*} 'the longest probe is reported'
+	}
+	for (i = `{seq 1 600})
+		tabletest-^$i =
+}
+
+test 'closure conversion' {
+	let (code = '%closure(n=0)@ *{n = `{expr $n + 1}; result $n}') {
+		let (a = $code^''; b = $code^'') {
+			$a; $a
+			assert {~ <={$a} 3 && ~ <={$b} 1} 'closures parsed from the same text have their own bindings'
+		}
+	}
+	let (seen = ()) {
+		for (i = 1 2 3) {
+			fn-conv-words = '%closure(x=a b c)@ {result $x}'^''
+			seen = $seen <={%count <={conv-words}}
+		}
+		assert {~ <={%flatten ' ' $seen} '3 3 3'} 'multi-word bindings survive a cached parse'
+	}
+	let (a = 1 2 3) fn conv-list {result $a}
+	fn-conv-copy = $fn-conv-list
+	assert {~ `` \n {$es -c 'echo <={conv-list} <={conv-copy}'} '1 2 3 1 2 3'} 'exported multi-word bindings are intact'
+	let (x = 1) {
+		fn-conv-get = @ {result $x}
+		fn-conv-set = @ v {x = $v}
+	}
+	assert {~ $fn-conv-get *x\=1*} 'a closure prints its bindings'
+	conv-set 2
+	assert {~ $fn-conv-get *x\=2*} 'assigning a binding changes the printed closure'
+	fn-conv-get = fn-conv-set = fn-conv-words = fn-conv-list = fn-conv-copy =
+}
+
+test 'arithmetic' {
+	assert {~ <={arith 1 + 2 '*' 3} 7 && ~ <={arith '(' 1 + 2 ')' '*' 3} 9} 'operators have C precedence'
+	assert {~ <={arith 7 / 2} 3 && ~ <={arith -7 % 3} -1 && ~ <={arith - 2 - -3} 1} 'integer division truncates'
+	assert {~ <={arith 1 '<<' 40} 1099511627776 && ~ <={arith 0xff '&' '~' 15 '^' 1} 241} 'shifts and bitwise operators'
+	assert {~ <={arith 3 lt 4} 1 && ~ <={arith 3 '>=' 4} 0 && ~ <={arith 5 = 5} 1} 'comparisons yield 1 or 0'
+	assert {~ <={arith 0 '&&' 1 / 0} 0 && ~ <={arith 1 '||' 1 / 0} 1} 'logical operators short-circuit'
+	assert {~ <={arith 1.5 '*' 2} 3 && ~ <={arith 1 / 4.0} 0.25 && ~ <={arith 1e3 + 1} 1001} 'decimal points make doubles'
+	assert {arithtest 2 lt 3 && !arithtest 2 gt 3 && !arithtest 0} 'arithtest is true for non-zero values'
+	let (i = 0; sum = 0) {
+		while {arithtest $i lt 100} {
+			sum = <={arith $sum + $i}
+			i = <={arith $i + 1}
+		}
+		assert {~ $sum 4950} 'loops can count'
+	}
+	for (e = '1 / 0' '9223372036854775807 + 1' '1.5 % 2' '1 +' '( 1' '1 x' '') {
+		let (ex = ()) {
+			catch @ e {ex = $e} {
+				arith $e
+			}
+			assert {~ $ex(1) error && ~ $ex(2) '$&arith'} 'bad expression:' $e
+		}
+	}
+}
+
+test 'tail calls' {
+	local (max-eval-depth = 200) {
+		fn tail-count n {
+			if {arithtest $n gt 0} {tail-count <={arith $n - 1}} {result $0 $n}
+		}
+		assert {~ <={tail-count 1000} (tail-count 0)} 'a function can call itself in tail position'
+		fn tail-even n {if {~ $n 0} {result even} {tail-odd <={arith $n - 1}}}
+		fn tail-odd n {if {~ $n 0} {result odd} {tail-even <={arith $n - 1}}}
+		assert {~ <={tail-even 501} odd} 'mutually recursive functions run in constant depth'
+		fn tail-seq n {
+			if {~ $n 0} {return $0}
+			tail-seq <={arith $n - 1}
+		}
+		assert {~ <={tail-seq 1000} tail-seq} 'the last command of a sequence is a tail call'
+		fn tail-deep n {tail-deep $n; true}
+		let (ex = ()) {
+			catch @ e type msg {ex = $msg} {tail-deep 1}
+			assert {~ $ex 'max-eval-depth exceeded'} 'other calls still count toward max-eval-depth'
+		}
+	}
+	fn tail-inner {return inner}
+	fn tail-outer {tail-inner; result $0}
+	assert {~ <={tail-outer} tail-outer} 'return only leaves the function which called it'
+	fn-tail-count = fn-tail-even = fn-tail-odd = fn-tail-seq = fn-tail-deep = fn-tail-inner = fn-tail-outer =
+}
+
+test 'return, break and continue' {
+	fn esc-if {if {true} {return a}; result b}
+	assert {~ <={esc-if} a} 'return leaves nested code'
+	fn esc-call {let (x = <={return c}) result d}
+	assert {~ <={esc-call} c} 'return works from within <={}'
+	fn esc-for {for (i = 1 2 3) {if {~ $i 2} {return $i}}; result none}
+	assert {~ <={esc-for} 2} 'return leaves a for loop'
+	fn esc-while {let (i = 0) while {true} {i = <={arith $i + 1}; if {~ $i 3} {return $i}}}
+	assert {~ <={esc-while} 3} 'return leaves a while loop'
+	let (cleaned = ()) {
+		fn esc-protect {unwind-protect {return e} {cleaned = yes}; result f}
+		assert {~ <={esc-protect} e && ~ $cleaned yes} 'unwind-protect cleanups run on return'
+	}
+	let (seen = ()) {
+		assert {~ <={for (i = 1 2 3 4) {
+			if {~ $i 2} {continue}
+			if {~ $i 4} {break done}
+			seen = $seen $i
+		}} done && ~ $seen (1 3)} 'break and continue in for'
+	}
+	let (seen = (); i = 0) {
+		while {!~ $i 4} {
+			i = <={arith $i + 1}
+			if {~ $i 2} {continue}
+			seen = $seen $i
+		}
+		assert {~ $seen (1 3 4)} 'continue in while'
+	}
+	fn esc-break {break g}
+	assert {~ <={for (i = 1 2) {esc-break; result h}} g} 'break leaves the loop around a function'
+	let (said = ()) {
+		fn esc-redefined {
+			local (fn-return = $&noreturn @ {said = $*; throw return $*}) {return i}
+			result j
+		}
+		assert {~ <={esc-redefined} i && ~ $said i} 'fn-return can be redefined'
+	}
+	fn-esc-if = fn-esc-call = fn-esc-for = fn-esc-while = fn-esc-protect = fn-esc-break = fn-esc-redefined =
+}
+
+test 'command cache' {
+	fn cache-inner {result one}
+	fn cache-outer {cache-inner}
+	assert {~ <={cache-outer} one}
+	fn cache-inner {result two}
+	assert {~ <={cache-outer} two} 'redefinitions are seen'
+	local (fn-cache-inner = {result three})
+		assert {~ <={cache-outer} three} 'local definitions are seen'
+	assert {~ <={cache-outer} two} 'the definition is restored after local'
+	let (fn-cache-inner = {result four})
+		assert {~ <={cache-inner} four} 'lexical definitions come first'
+	let (dir = `{mktemp -d cache-dir.XXXXXX}) {
+		mkdir $dir/a $dir/b
+		for (d = a b) echo '#!/bin/sh'\n'echo '$d > $dir/$d/cache-prog
+		chmod 755 $dir/a/cache-prog $dir/b/cache-prog
+		fn cache-run {cache-prog}
+		local (path = $dir/a $path) {
+			cache-run > $dir/out
+			assert {~ `{cat $dir/out} a} 'programs are found'
+			path = $dir/b $path
+			cache-run > $dir/out
+			assert {~ `{cat $dir/out} b} 'changes to $path are seen'
+		}
+		rm -rf $dir
+	}
+	fn-cache-inner = fn-cache-outer = fn-cache-run =
+}
+
+test 'programs run by the shell' {
+	let (tmp = `{mktemp spawn-file.XXXXXX}) {
+		sh -c 'echo out; echo err >&2' > $tmp >[2=1]
+		assert {~ `` \n {cat $tmp} (out err)} 'redirections apply to programs'
+		sh -c 'echo three >&3' >[3] $tmp
+		assert {~ `{cat $tmp} three} 'other descriptors can be redirected'
+		assert {!sh -c 'echo closed' >[1=] >[2] /dev/null} 'closed descriptors stay closed'
+		echo junk > $tmp
+		chmod 755 $tmp
+		assert {~ `` \n {./$tmp >[2=1]} *': Exec format error'} 'exec failures are reported'
+		rm -f $tmp
+	}
+	assert {~ `{$es -c 'signals = $signals /sigusr1; echo <={sh -c ''kill -USR1 $$; exit 3''}' >[2] /dev/null} sigusr1} \
+		'ignored signals are reset for programs'
+}
+
+test 'path search' {
+	let (dir = `pwd^/^`{mktemp -d search-dir.XXXXXX}) {
+		mkdir $dir/a $dir/b
+		echo '#!/bin/sh'\n'echo b' > $dir/b/search-prog
+		chmod 755 $dir/b/search-prog
+		local (path = $dir/a $dir/b $path) {
+			assert {~ <={%pathsearch search-prog} $dir/b/search-prog} 'programs are found'
+			assert {~ `search-prog b}
+			echo '#!/bin/sh'\n'echo a' > $dir/a/search-prog
+			chmod 755 $dir/a/search-prog
+			assert {~ `search-prog a} 'new programs earlier in $path are seen'
+			rm $dir/a/search-prog
+			assert {~ `search-prog b} 'removed programs are noticed'
+			touch $dir/a/search-prog
+			assert {~ <={%pathsearch search-prog} <={access -n search-prog -1e -xf $path}} 'files which cannot be run are passed over'
+			rm $dir/b/search-prog
+			let (msg = ()) {
+				catch @ e type m {msg = $type $m} {%pathsearch search-prog}
+				assert {~ $msg(2) 'search-prog: Permission denied'} 'the most telling error is reported'
+				assert {~ $msg(1) '$&access'} 'errors come from $&access, as before'
+			}
+		}
+		rm -rf $dir
+	}
+}
+
+test 'backquote in the shell' {
+	fn bq-greet name {echo hello $name; echo <={%flatten - a b}}
+	fn bq-set {bq-var = set; echo set}
+	assert {~ `{bq-greet world} (hello world a-b)} 'function output is captured'
+	assert {~ ``\n{echo -n 'a b'; echo ' c'} 'a b c'} 'separators are honored'
+	let (x = `{result 3}) assert {~ $bqstatus 3 && ~ $x ()} 'status is returned'
+	let (x = `{catch @ e {echo caught $e} {echo in; throw error x y}})
+		assert {~ $x (in caught error x y)} 'exceptions are caught'
+	let (x = ()) {
+		{x = `{echo out; throw error bq-error msg}} >[2] /dev/null
+		assert {~ $x out && ~ $bqstatus 1} 'uncaught exceptions end the body'
+	}
+	let (x = `{bq-set})
+		assert {~ $x set && ~ $bq-var ()} 'assignments do not escape'
+	fn bq-count {let (last = $*($#*)) for (i = $*) echo $i $last}
+	let (n = `{seq 1 5000}; x = ()) {
+		$&allocprofile 64
+		x = `{bq-count $n}
+		$&allocprofile 0
+		assert {~ $#x 10000 && ~ $x(9999) 5000 && ~ $x(10000) 5000} 'large output is captured'
+		assert {~ <={$&allocprofile} *bq-count*} 'pure bodies run in the shell'
+	}
+	let (f = {cd /; bq-leak = leaked}; dir = `pwd) {
+		let (y = `{if {true} $f})
+			assert {~ $bq-leak () && ~ `pwd $dir} 'closures passed in variables run in a child'
+		fn bq-run c {if {true} $c}
+		let (y = `{bq-run $f})
+			assert {~ $bq-leak () && ~ `pwd $dir} 'closures passed to functions run in a child'
+	}
+	let (x = ()) {
+		{x = `{echo out; arith 1 / 0}} >[2] /dev/null
+		assert {~ $x out && ~ $bqstatus 1} 'errors end a body run in the shell'
+	}
+	fn-bq-greet = fn-bq-set = fn-bq-count = fn-bq-run =
+}
+
+test 'background jobs' {
+	let (pids = (); statuses = ()) {
+		for (i = `{seq 1 40}) {
+			sh -c 'exit '^$i &
+			pids = $pids $apid
+		}
+		assert {~ <={%apids} $pids && ~ $#pids 40} 'background jobs are listed'
+		for (p = $pids(21 ... 40) $pids(1 ... 20))
+			statuses = $statuses <={wait $p}
+		assert {~ $statuses(1) 21 && ~ $statuses(20) 40 && ~ $statuses(40) 20} 'each job is waited for'
+		assert {~ <={%apids} ()} 'waited jobs are forgotten'
+	}
+	sh -c 'exit 7' &
+	assert {~ <={wait} 7} 'any job can be waited for'
+	let (script = 'sh -c ''exit 5'' & exec "$0" -c ''sleep 0.2 & wait; echo <={wait ''$!''}''')
+		assert {~ `{sh -c $script $es} 5} 'statuses passed over by a wait for any job are kept'
+}
+
+test 'parallel' {
+	assert {~ `{%parallel 3 @ x {sleep 0.$x; echo $x} 3 1 2 1} (3 1 2 1)} 'output is in the order of the arguments'
+	assert {~ <={%parallel 2 @ x {sh -c 'exit '^$x} 0 3 0 5} (0 3 0 5)} 'each status is returned in order'
+	let (lines = `{%parallel 4 @ i {seq 1 5000 | sed 's/^/'^$i^'./'} a b c d}) {
+		assert {~ $#lines 20000 && ~ $lines(5000) a.5000 && ~ $lines(5001) b.1 && ~ $lines(20000) d.5000} 'held output is passed on whole'
+	}
+	assert {~ <={%parallel 100 true a b} (0 0) && ~ <={%parallel 2 true} ()} 'limits and empty lists'
+	let (ex = ()) {
+		catch @ e {ex = $e} {
+			%parallel 0 echo a
+		}
+		assert {~ $ex(1) error} 'bad limits are rejected'
+	}
+}
@@ -18,10 +18,15 @@ static Tree *gmk(void *(*alloc)(size_t, Tag *), NodeKind t, va_list ap) {
 		n = alloc(offsetof(Tree, u[1]), &Tree1Tag);
 		n->u[0].s = va_arg(ap, char *);
 		break;
-	    case nCall: case nThunk: case nVar:
+	    case nCall: case nThunk:
 		n = alloc(offsetof(Tree, u[1]), &Tree1Tag);
 		n->u[0].p = va_arg(ap, Tree *);
 		break;
+	    case nVar:
+		n = alloc(offsetof(Tree, u[2]), &Tree2Tag);
+		n->u[0].p = va_arg(ap, Tree *);
+		n->u[1].i = 0;		/* unresolved; see resolve() */
+		break;
 	    case nAssign:  case nConcat: case nClosure: case nFor:
 	    case nLambda: case nLet: case nList:  case nLocal:
 	    case nVarsub: case nMatch: case nExtract:
@@ -92,7 +97,7 @@ static size_t Tree1Scan(void *p) {
 	    case nPrim: case nWord: case nQword:
 		n->u[0].s = forward(n->u[0].s);
 		break;
-	    case nCall: case nThunk: case nVar:
+	    case nCall: case nThunk:
 		n->u[0].p = forward(n->u[0].p);
 		break;
 	} 
@@ -108,6 +113,9 @@ static size_t Tree2Scan(void *p) {
 		n->u[0].p = forward(n->u[0].p);
 		n->u[1].p = forward(n->u[1].p);
 		break;
+	    case nVar:
+		n->u[0].p = forward(n->u[0].p);
+		break;
 	    default:
 		panic("Tree2Scan: bad node kind %d", n->kind);
 	} 
@@ -8,9 +8,11 @@
 
 #if PROTECT_ENV
 #define	ENV_FORMAT	"%F=%W"
+#define	ENV_PREFIX	"%F="
 #define	ENV_DECODE	"%N"
 #else
 #define	ENV_FORMAT	"%s=%W"
+#define	ENV_PREFIX	"%s="
 #define	ENV_DECODE	"%s"
 #endif
 
@@ -18,6 +20,7 @@
 
 #define VECPUSH(vec, elt) STMT( \
 	(vec)->vector[(vec)->count++] = (elt); \
+	gcremember((vec), (elt)); \
 	if ((vec)->count == (vec)->alloclen) { \
 		Vector *CONCAT(new_,vec) = mkvector((vec)->alloclen * 2); \
 		CONCAT(new_,vec)->count = (vec)->count; \
@@ -33,6 +36,18 @@ static Vector *env, *sortenv;
 static int envmin;
 static Boolean isdirty = TRUE;
 static Boolean rebound = TRUE;
+unsigned long rebindings = 0;
+unsigned long redefinitions = 0;
+
+/*
+ * once sortenv has been built, changes to exported variables are
+ * recorded by name in changed and patched into it one at a time;
+ * boundenv holds the exported names whose values are closures with
+ * bindings, which must be re-encoded after any lexical assignment.
+ */
+static Vector *changed;
+static Dict *boundenv;
+static char envmark = '*';
 
 DefineTag(Var, static);
 
@@ -113,6 +128,27 @@ static Boolean isexported(const char *name) {
 	return dictget(noexport, name) == NULL;
 }
 
+/* redefined -- note a change which may alter how a command is found */
+static void redefined(const char *name) {
+	if (hasprefix(name, "fn-") || streq(name, "path") || streq(name, "PATH"))
+		++redefinitions;
+}
+
+/* envchanged -- note that an exported variable needs updating in the environment */
+static void envchanged(char *name) {
+	if (isdirty || !isexported(name))
+		return;
+	if (changed->count > 0 && changed->vector[changed->count - 1] == name)
+		return;
+	if (changed->count == changed->alloclen) {
+		isdirty = TRUE;		/* too much to patch; rebuild it all */
+		return;
+	}
+	changed->vector[changed->count++] = name;
+	changed->vector[changed->count] = NULL;
+	gcremember(changed, name);
+}
+
 /* setnoexport -- mark a list of variable names not for export */
 extern void setnoexport(List *list) {
 	static char noexportchar = '!';
@@ -141,7 +177,7 @@ extern List *varlookup(const char *name, Binding *bp) {
 
 	validatevar(name);
 	for (; bp != NULL; bp = bp->next)
-		if (streq(name, bp->name))
+		if (bp->name == name || streq(name, bp->name))
 			return bp->defn;
 
 	var = dictget(vars, name);
@@ -152,17 +188,38 @@ extern List *varlookup(const char *name, Binding *bp) {
 
 extern List *varlookup2(char *name1, char *name2, Binding *bp) {
 	Var *var;
-	
-	for (; bp != NULL; bp = bp->next)
-		if (streq2(bp->name, name1, name2))
-			return bp->defn;
 
-	var = dictget2(vars, name1, name2);
+	if (issymbol(name2)) {
+		char *name = symprefix(name1, name2);
+		for (; bp != NULL; bp = bp->next)
+			if (bp->name == name || streq(name, bp->name))
+				return bp->defn;
+		var = dictget(vars, name);
+	} else {
+		for (; bp != NULL; bp = bp->next)
+			if (streq2(bp->name, name1, name2))
+				return bp->defn;
+		var = dictget2(vars, name1, name2);
+	}
 	if (var == NULL)
 		return NULL;
 	return var->defn;
 }
 
+/* isbound2 -- is name1^name2 bound in a chain of lexical bindings? */
+extern Boolean isbound2(char *name1, char *name2, Binding *bp) {
+	if (issymbol(name2)) {
+		char *name = symprefix(name1, name2);
+		for (; bp != NULL; bp = bp->next)
+			if (bp->name == name || streq(name, bp->name))
+				return TRUE;
+	} else
+		for (; bp != NULL; bp = bp->next)
+			if (streq2(bp->name, name1, name2))
+				return TRUE;
+	return FALSE;
+}
+
 static List *callsettor(char *name, List *defn) {
 	Push p;
 	List *settor;
@@ -186,18 +243,20 @@ static void vardef0(char *name, Binding *binding, List *defn, Boolean startup) {
 
 	validatevar(name);
 	for (; binding != NULL; binding = binding->next)
-		if (streq(name, binding->name)) {
+		if (binding->name == name || streq(name, binding->name)) {
 			binding->defn = defn;
+			gcremember(binding, defn);
 			rebound = TRUE;
+			++rebindings;
 			return;
 		}
 
 	RefAdd(name);
 	if (!startup) {
 		defn = callsettor(name, defn);
-		if (isexported(name))
-			isdirty = TRUE;
+		envchanged(name);
 	}
+	redefined(name);
 
 	var = dictget(vars, name);
 	if (var != NULL)
@@ -205,6 +264,7 @@ static void vardef0(char *name, Binding *binding, List *defn, Boolean startup) {
 			var->defn = defn;
 			var->env = NULL;
 			var->flags = hasbindings(defn) ? var_hasbindings : 0;
+			gcremember(var, defn);
 		} else
 			vars = dictput(vars, name, NULL);
 	else if (defn != NULL) {
@@ -227,9 +287,9 @@ extern void varpush(Push *push, char *name, List *defn) {
 	push->nameroot.p = (void **) &push->name;
 	rootlist = &push->nameroot;
 
-	if (isexported(name))
-		isdirty = TRUE;
+	envchanged(push->name);
 	defn = callsettor(name, defn);
+	redefined(push->name);
 
 	var = dictget(vars, push->name);
 	if (var == NULL) {
@@ -243,6 +303,7 @@ extern void varpush(Push *push, char *name, List *defn) {
 		var->defn	= defn;
 		var->env	= NULL;
 		var->flags	= hasbindings(defn) ? var_hasbindings : 0;
+		gcremember(var, defn);
 	}
 
 	push->next = pushlist;
@@ -261,8 +322,7 @@ extern void varpop(Push *push) {
 	assert(rootlist == &push->defnroot);
 	assert(rootlist->next == &push->nameroot);
 
-	if (isexported(push->name))
-		isdirty = TRUE;
+	envchanged(push->name);
 
 	ExceptionHandler
 
@@ -274,6 +334,7 @@ extern void varpop(Push *push) {
 
 	EndExceptionHandler;
 
+	redefined(push->name);
 	var = dictget(vars, push->name);
 
 	if (var != NULL)
@@ -281,6 +342,7 @@ extern void varpop(Push *push) {
 			var->defn = push->defn;
 			var->flags = push->flags;
 			var->env = NULL;
+			gcremember(var, push->defn);
 		} else
 			vars = dictput(vars, push->name, NULL);
 	else if (push->defn != NULL) {
@@ -297,39 +359,112 @@ extern void varpop(Push *push) {
 		throw(except);
 }
 
-static void mkenv0(void UNUSED *dummy, char *key, void *value) {
-	Var *var = value;
+/* envstring -- the environment entry for a variable, or NULL if it is not exported */
+static char *envstring(char *name, Var *var) {
 	assert(gcisblocked());
 	if (
 		   var == NULL
 		|| var->defn == NULL
 		|| (var->flags & var_isinternal)
-		|| !isexported(key)
+		|| !isexported(name)
 	)
-		return;
+		return NULL;
 	if (var->env == NULL || (rebound && (var->flags & var_hasbindings))) {
-		char *envstr = str(ENV_FORMAT, key, var->defn);
+		char *envstr = str(ENV_FORMAT, name, var->defn);
 		var->env = envstr;
+		gcremember(var, envstr);
 	}
+	return var->env;
+}
+
+static void mkenv0(void UNUSED *dummy, char *key, void *value) {
+	Var *var = value;
+	char *envstr = envstring(key, var);
+	if (envstr == NULL)
+		return;
+	if (var->flags & var_hasbindings)
+		boundenv = dictput(boundenv, key, &envmark);
 	assert(env->count < env->alloclen);
-	VECPUSH(env, var->env);
+	VECPUSH(env, envstr);
+}
+
+/* envreplace -- replace, insert or remove the entry for name in sortenv */
+static void envreplace(char *name, char *envstr) {
+	int lo, hi, len;
+	char **vp;
+	char *prefix = str(ENV_PREFIX, name);
+
+	assert(gcisblocked());
+	len = strlen(prefix);
+	for (lo = 0, hi = sortenv->count; lo < hi;) {
+		int mid = (lo + hi) / 2;
+		if (strcmp(sortenv->vector[mid], prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	vp = &sortenv->vector[lo];
+	if (lo < sortenv->count && strneq(*vp, prefix, len)) {
+		if (envstr == NULL) {
+			memmove(vp, vp + 1, (sortenv->count - lo) * sizeof (char *));
+			--sortenv->count;
+			return;
+		}
+	} else {
+		if (envstr == NULL)
+			return;
+		if (sortenv->count == sortenv->alloclen) {
+			Vector *grown = mkvector(sortenv->alloclen * 2);
+			memcpy(grown->vector, sortenv->vector, sizeof (char *) * (sortenv->count + 1));
+			grown->count = sortenv->count;
+			sortenv = grown;
+			vp = &sortenv->vector[lo];
+		}
+		memmove(vp + 1, vp, (sortenv->count - lo + 1) * sizeof (char *));
+		++sortenv->count;
+	}
+	*vp = envstr;
+	gcremember(sortenv, envstr);
+}
+
+/* envupdate -- bring one variable's entry in sortenv up to date */
+static void envupdate(void UNUSED *dummy, char *key, void UNUSED *value) {
+	Var *var = dictget(vars, key);
+	char *envstr = envstring(key, var);
+	boundenv = dictput(boundenv, key,
+			   (envstr != NULL && (var->flags & var_hasbindings)) ? &envmark : NULL);
+	envreplace(key, envstr);
 }
-	
+
 extern Vector *mkenv(void) {
-	if (isdirty || rebound) {
+	if (isdirty) {
+		int i;
 		env->count = envmin;
 		gcdisable();		/* TODO: make this a good guess */
+		boundenv = mkdict();
 		dictforall(vars, mkenv0, NULL);
 		gcenable();
 		env->vector[env->count] = NULL;
-		isdirty = FALSE;
-		rebound = FALSE;
 		if (sortenv == NULL || env->count > sortenv->alloclen)
 			sortenv = mkvector(env->count * 2);
 		sortenv->count = env->count;
 		memcpy(sortenv->vector, env->vector, sizeof (char *) * (env->count + 1));
+		for (i = 0; i < sortenv->count; i++)
+			gcremember(sortenv, sortenv->vector[i]);
 		sortvector(sortenv);
+	} else if (rebound || changed->count > 0) {
+		int i;
+		gcdisable();
+		if (rebound)
+			dictforall(boundenv, envupdate, NULL);
+		for (i = 0; i < changed->count; i++)
+			envupdate(NULL, changed->vector[i], NULL);
+		gcenable();
 	}
+	isdirty = FALSE;
+	rebound = FALSE;
+	changed->count = 0;
+	changed->vector[0] = NULL;
 	return sortenv;
 }
 
@@ -381,16 +516,94 @@ static void hide(void UNUSED *dummy, char UNUSED *key, void *value) {
 
 /* hidevariables -- mark all variables as internal */
 extern void hidevariables(void) {
+	isdirty = TRUE;
 	dictforall(vars, hide, NULL);
 }
 
+/* countvar -- worker function for dictforall to count variables */
+static void countvar(void *arg, char UNUSED *key, void UNUSED *value) {
+	++*(size_t *) arg;
+}
+
+/* freezedefn -- worker function for dictforall to gather definitions to freeze */
+static void freezedefn(void *arg, char UNUSED *key, void *value) {
+	void ****fp = arg;
+	*(*fp)++ = (void **) &((Var *) value)->defn;
+}
+
+/* freezevars -- move the definitions of variables into the permanent region */
+extern void freezevars(List *names) {
+	size_t n;
+	void ***roots, ***fp;
+
+	if (names == NULL) {
+		n = 0;
+		dictforall(vars, countvar, &n);
+		roots = fp = ealloc((n + 1) * sizeof (void **));
+		dictforall(vars, freezedefn, &fp);
+	} else {
+		roots = fp = ealloc((length(names) + 1) * sizeof (void **));
+		for (; names != NULL; names = names->next) {
+			Var *var = dictget(vars, getstr(names->term));
+			if (var != NULL)
+				*fp++ = (void **) &var->defn;
+		}
+	}
+	n = fp - roots;
+	if (n > 0)
+		gcfreeze(roots, n);
+	efree(roots);
+}
+
+typedef struct {
+	char **name;
+	void **root;
+} CensusRoots;
+
+/* censusroot -- worker function for dictforall to gather the roots for a census */
+static void censusroot(void *arg, char *key, void *value) {
+	CensusRoots *cr = arg;
+	*cr->name++ = key;
+	*cr->root++ = ((Var *) value)->defn;
+}
+
+/* varstats -- report on the hashing of the variable table */
+extern void varstats(DictStats *stats) {
+	dictstats(vars, stats);
+}
+
+/* censusvars -- take a census of the heap, noting what the variables hold */
+extern int censusvars(GCCensus types[], int ntypes,
+		      GCLargest largest[], int nlargest, GCLargest holders[], int nholders) {
+	int result;
+	size_t n = 0;
+	char **names;
+	void **roots;
+	CensusRoots cr;
+
+	assert(gcisblocked());		/* the roots are in the heap */
+	dictforall(vars, countvar, &n);
+	cr.name = names = ealloc((n + 1) * sizeof (char *));
+	cr.root = roots = ealloc((n + 1) * sizeof (void *));
+	dictforall(vars, censusroot, &cr);
+	result = gccensus(names, roots, cr.name - names, types, ntypes,
+			  largest, nlargest, holders, nholders);
+	efree(roots);
+	efree(names);
+	return result;
+}
+
 /* initvars -- initialize the variable machinery */
 extern void initvars(void) {
 	globalroot(&vars);
 	globalroot(&noexport);
 	globalroot(&env);
 	globalroot(&sortenv);
+	globalroot(&changed);
+	globalroot(&boundenv);
 	vars = mkdict();
+	changed = mkvector(ENVSIZE);
+	boundenv = mkdict();
 	noexport = NULL;
 	env = mkvector(ENVSIZE);
 }
@@ -428,6 +641,8 @@ static void importvar(char *name0, char *value) {
 						strcpy(str + offset, str2);
 						list->term->str = str;
 						list->next = list->next->next;
+						gcremember(list->term, str);
+						gcremember(list, list->next);
 					}
 					break;
 				    case ENV_ESCAPE: {
@@ -436,6 +651,7 @@ static void importvar(char *name0, char *value) {
 					memcpy(str, word, offset);
 					strcpy(str + offset, escape + 2);
 					list->term->str = str;
+					gcremember(list->term, str);
 					offset += 1;
 					break;
 				    }
@@ -588,6 +804,7 @@ extern void initenv(char **envp, Boolean protected) {
 		var = dictget(vars, name);
 		defn = callsettor(name, var->defn);
 		var->defn = defn;
+		gcremember(var, defn);
 	}
 
 	RefEnd2(var, imported);
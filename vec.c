@@ -42,6 +42,7 @@ extern Vector *vectorize(List *list) {
 	for (i = 0; lp != NULL; lp = lp->next, i++) {
 		char *s = getstr(lp->term); /* must evaluate before v->vector[i] */
 		v->vector[i] = s;
+		gcremember(v, s);
 	}
 
 	RefEnd(lp);